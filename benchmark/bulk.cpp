@@ -0,0 +1,63 @@
+#include <radix_cpp.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include <sys/time.h>
+#include <time.h>
+
+// compares the per-key insert loop to the sort-based bulk loader
+
+template <typename T>
+static std::vector<T> make_test_data(size_t n, bool sparse) {
+  std::vector<T> v;
+  auto rng = std::mt19937_64 {};
+  for (size_t i = 0; i < n; i++) v.push_back(sparse ? static_cast<T>(rng()) : static_cast<T>(i));
+  std::shuffle(std::begin(v), std::end(v), rng);
+  return v;
+}
+
+static double get_wall_time() {
+  struct timeval time;
+  if (gettimeofday(&time,NULL)){
+    //  Handle error
+    return 0;
+  }
+  return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
+
+template <typename T>
+static void run(const char * name, size_t n, bool sparse) {
+  auto v = make_test_data<T>(n, sparse);
+  double t0, t1, t2;
+  size_t size1, size2;
+  
+  {
+    radix_cpp::set<T> S;
+    t0 = get_wall_time();
+    for (auto & a : v) {
+      S.insert(a);
+    }
+    t1 = get_wall_time();
+    size1 = S.size();
+  }
+  {
+    t2 = get_wall_time();
+    radix_cpp::set<T> S(v.begin(), v.end());
+    t2 = get_wall_time() - t2;
+    size2 = S.size();
+  }
+
+  std::cout << name << ";" << n << ";" << t1 - t0 << ";" << t2 << ";" << size1 << ";" << size2 << std::endl;
+}
+
+int main() {
+  std::cout << "type;n;insert loop;bulk load;size;size\n";
+  for (size_t n = 1000000; n <= 16000000; n *= 2) {
+    run<uint32_t>("uint32 dense", n, false);
+    run<uint32_t>("uint32 sparse", n, true);
+  }
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include <radix_cpp.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+
+#include <sys/time.h>
+#include <time.h>
+
+// replaces the keys of a set of constant size, which leaves tombstones in the node array
+
+static double get_wall_time() {
+  struct timeval time;
+  if (gettimeofday(&time,NULL)){
+    //  Handle error
+    return 0;
+  }
+  return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
+
+int main() {
+  std::cout << "n;rounds;churn;find;tombstones;resizes\n";
+  for (size_t n = 500000; n <= 2000000; n *= 2) {
+    auto rng = std::mt19937_64 {};
+    std::vector<uint64_t> keys;
+    radix_cpp::set<uint64_t> S;
+    for (size_t i = 0; i < n; i++) {
+      keys.push_back(rng());
+      S.insert(keys.back());
+    }
+    size_t rounds = 8;
+    auto t0 = get_wall_time();
+    for (size_t r = 0; r < rounds; r++) {
+      for (auto & k : keys) {
+	S.erase(k);
+	k = rng();
+	S.insert(k);
+      }
+    }
+    auto t1 = get_wall_time();
+    size_t found = 0;
+    for (size_t i = 0; i < n; i++) {
+      found += S.count(rng());
+    }
+    auto t2 = get_wall_time();
+    std::cout << n << ";" << rounds << ";" << t1 - t0 << ";" << t2 - t1 << ";" << S.num_tombstones() << ";" << S.num_resizes() << std::endl;
+    if (found) return 1;
+  }
+  return 0;
+}
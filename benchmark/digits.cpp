@@ -0,0 +1,67 @@
+#include <radix_cpp.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include <sys/time.h>
+#include <time.h>
+
+// compares the digit widths for dense and sparse integer sets
+
+template <typename T>
+static std::vector<T> make_test_data(size_t n, bool sparse) {
+  std::vector<T> v;
+  auto rng = std::mt19937_64 {};
+  for (size_t i = 0; i < n; i++) v.push_back(sparse ? static_cast<T>(rng()) : static_cast<T>(i));
+  std::shuffle(std::begin(v), std::end(v), rng);
+  return v;
+}
+
+static double get_wall_time() {
+  struct timeval time;
+  if (gettimeofday(&time,NULL)){
+    //  Handle error
+    return 0;
+  }
+  return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
+
+template <typename T, size_t DigitBits>
+static void run(const char * name, const std::vector<T> & v) {
+  radix_cpp::set<T, DigitBits> S;
+  auto t0 = get_wall_time();
+  for (auto & a : v) {
+    S.insert(a);
+  }
+  auto t1 = get_wall_time();
+  T sum = 0;
+  for (auto & a : S) {
+    sum += a;
+  }
+  auto t2 = get_wall_time();
+  size_t found = 0;
+  for (auto & a : v) {
+    found += S.count(a);
+  }
+  auto t3 = get_wall_time();
+
+  std::cout << name << ";" << DigitBits << ";" << v.size() << ";" << t1 - t0 << ";" << t2 - t1 << ";" << t3 - t2 << ";" << sum % 10 << ";" << found << std::endl;
+}
+
+int main() {
+  std::cout << "type;digit bits;n;insert;iterate;find;checksum;found\n";
+  for (size_t n = 1000000; n <= 2000000; n *= 2) {
+    auto dense = make_test_data<uint32_t>(n, false);
+    run<uint32_t, 4>("uint32 dense", dense);
+    run<uint32_t, 8>("uint32 dense", dense);
+    run<uint32_t, 16>("uint32 dense", dense);
+
+    // every 16-bit Level is an 8 kB bitmap, which is too much for sparse keys
+    auto sparse = make_test_data<uint64_t>(n, true);
+    run<uint64_t, 4>("uint64 sparse", sparse);
+    run<uint64_t, 8>("uint64 sparse", sparse);
+  }
+  return 0;
+}
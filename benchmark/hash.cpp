@@ -0,0 +1,63 @@
+#include <radix_cpp.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <string>
+#include <algorithm>
+
+#include <sys/time.h>
+#include <time.h>
+
+// compares the insert and find throughput of the hash policies
+
+static double get_wall_time() {
+  struct timeval time;
+  if (gettimeofday(&time,NULL)){
+    //  Handle error
+    return 0;
+  }
+  return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
+
+template <typename T, typename Hash, typename Gen>
+static void run(const char * type, const char * policy, size_t n, Gen gen) {
+  auto rng = std::mt19937_64 {};
+  std::vector<T> keys;
+  for (size_t i = 0; i < n; i++) keys.push_back(gen(rng));
+
+  radix_cpp::set<T, 8, Hash> S;
+  auto t0 = get_wall_time();
+  for (auto & a : keys) {
+    S.insert(a);
+  }
+  auto t1 = get_wall_time();
+  std::shuffle(std::begin(keys), std::end(keys), rng);
+  size_t found = 0;
+  auto t2 = get_wall_time();
+  for (auto & a : keys) {
+    found += S.count(a);
+  }
+  auto t3 = get_wall_time();
+
+  std::cout << type << ";" << policy << ";" << n << ";" << static_cast<double>(n) / (t1 - t0) / 1e6 << ";" << static_cast<double>(n) / (t3 - t2) / 1e6 << ";" << found << std::endl;
+}
+
+template <typename Hash>
+static void run_all(const char * policy, size_t n) {
+  run<uint64_t, Hash>("uint64 sparse", policy, n, [](auto & rng) { return static_cast<uint64_t>(rng()); });
+  run<uint32_t, Hash>("uint32 dense", policy, n, [n](auto & rng) { return static_cast<uint32_t>(rng() % (2 * n)); });
+  run<std::string, Hash>("string", policy, n / 2, [](auto & rng) {
+      return "user/" + std::to_string(rng() % 100000000) + "/item/" + std::to_string(rng() % 1000);
+    });
+}
+
+int main() {
+  std::cout << "type;policy;n;insert Mops;find Mops;found\n";
+  for (size_t n = 1000000; n <= 4000000; n *= 2) {
+    run_all<radix_cpp::murmur3_hash>("murmur3", n);
+    run_all<radix_cpp::multiplicative_hash>("multiplicative", n);
+    run_all<radix_cpp::wyhash_hash>("wyhash", n);
+  }
+  return 0;
+}
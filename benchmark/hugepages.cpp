@@ -0,0 +1,59 @@
+#include <radix_cpp.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+#include <sys/time.h>
+#include <time.h>
+
+// compares the default allocation of the node array with huge pages, which reduce the TLB misses of the probes
+
+static double get_wall_time() {
+  struct timeval time;
+  if (gettimeofday(&time,NULL)){
+    //  Handle error
+    return 0;
+  }
+  return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
+
+template <typename Allocator>
+static void run(const char * name, size_t n, const Allocator & alloc) {
+  auto rng = std::mt19937_64 {};
+  std::vector<uint64_t> keys;
+  for (size_t i = 0; i < n; i++) keys.push_back(rng());
+
+  radix_cpp::set<uint64_t, 8, radix_cpp::murmur3_hash, Allocator> S(alloc);
+  auto t0 = get_wall_time();
+  for (auto & a : keys) {
+    S.insert(a);
+  }
+  auto t1 = get_wall_time();
+  std::shuffle(std::begin(keys), std::end(keys), rng);
+  size_t found = 0;
+  auto t2 = get_wall_time();
+  for (auto & a : keys) {
+    found += S.count(a);
+  }
+  auto t3 = get_wall_time();
+  uint64_t sum = 0;
+  for (auto & a : S) {
+    sum += a;
+  }
+  auto t4 = get_wall_time();
+
+  std::cout << name << ";" << n << ";" << t1 - t0 << ";" << t3 - t2 << ";" << t4 - t3 << ";" << found + (sum & 1) << std::endl;
+}
+
+int main() {
+  using huge = radix_cpp::huge_page_allocator<uint64_t>;
+  std::cout << "allocation;n;insert;find;iterate;found\n";
+  for (size_t n = 2000000; n <= 16000000; n *= 2) {
+    run("default", n, std::allocator<uint64_t>());
+    run("huge pages", n, huge());
+    run("huge pages interleaved", n, huge(radix_cpp::numa_policy::interleave));
+  }
+  return 0;
+}
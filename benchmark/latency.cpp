@@ -0,0 +1,48 @@
+#include <radix_cpp.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <chrono>
+
+// measures the insert latency percentiles with and without incremental resizing
+
+static std::vector<uint64_t> make_test_data(size_t n) {
+  std::vector<uint64_t> v;
+  auto rng = std::mt19937_64 {};
+  for (size_t i = 0; i < n; i++) v.push_back(rng());
+  return v;
+}
+
+static void run(const std::vector<uint64_t> & v, bool incremental) {
+  std::vector<double> latencies;
+  latencies.reserve(v.size());
+
+  radix_cpp::set<uint64_t> S;
+  S.set_incremental_resize(incremental);
+  for (auto & a : v) {
+    auto t0 = std::chrono::steady_clock::now();
+    S.insert(a);
+    auto t1 = std::chrono::steady_clock::now();
+    latencies.push_back(std::chrono::duration<double, std::micro>(t1 - t0).count());
+  }
+
+  double total = 0;
+  for (auto & l : latencies) total += l;
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&](double p) { return latencies[static_cast<size_t>(p * static_cast<double>(latencies.size() - 1))]; };
+  
+  std::cout << (incremental ? "incremental" : "stop-the-world") << ";" << v.size() << ";" << total / 1e6 << ";"
+	    << percentile(0.5) << ";" << percentile(0.99) << ";" << percentile(0.9999) << ";" << latencies.back() << std::endl;
+}
+
+int main() {
+  std::cout << "mode;n;total (s);p50 (us);p99 (us);p99.99 (us);max (us)\n";
+  for (size_t n = 1000000; n <= 4000000; n *= 2) {
+    auto v = make_test_data(n);
+    run(v, false);
+    run(v, true);
+  }
+  return 0;
+}
@@ -0,0 +1,59 @@
+#include <radix_cpp.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+
+#include <sys/time.h>
+#include <time.h>
+
+// compares loading a saved table by mapping the file with rebuilding it by inserting the keys
+
+static double get_wall_time() {
+  struct timeval time;
+  if (gettimeofday(&time,NULL)){
+    //  Handle error
+    return 0;
+  }
+  return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
+
+int main() {
+  const char * path = "load_benchmark.map";
+  std::cout << "n;build;save;load;first find;find mapped;find built;found\n";
+  for (size_t n = 1000000; n <= 8000000; n *= 2) {
+    auto rng = std::mt19937_64 {};
+    std::vector<uint64_t> keys;
+    for (size_t i = 0; i < n; i++) keys.push_back(rng());
+
+    auto t0 = get_wall_time();
+    radix_cpp::map<uint64_t, uint64_t> M;
+    for (auto & a : keys) {
+      M[a] = a;
+    }
+    auto t1 = get_wall_time();
+    M.save(path);
+    auto t2 = get_wall_time();
+    radix_cpp::map<uint64_t, uint64_t> L;
+    L.load(path);
+    auto t3 = get_wall_time();
+    size_t found = L.count(keys[n / 2]);
+    auto t4 = get_wall_time();
+
+    std::shuffle(std::begin(keys), std::end(keys), rng);
+    for (auto & a : keys) {
+      found += L.count(a);
+    }
+    auto t5 = get_wall_time();
+    for (auto & a : keys) {
+      found += M.count(a);
+    }
+    auto t6 = get_wall_time();
+
+    std::cout << n << ";" << t1 - t0 << ";" << t2 - t1 << ";" << t3 - t2 << ";" << t4 - t3 << ";" << t5 - t4 << ";" << t6 - t5 << ";" << found << std::endl;
+    std::remove(path);
+  }
+  return 0;
+}
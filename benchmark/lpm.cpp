@@ -0,0 +1,53 @@
+#include <radix_cpp.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <iterator>
+
+#include <sys/time.h>
+#include <time.h>
+
+// compares single and batched longest prefix matches in a routing table of random IPv4 prefixes
+
+static double get_wall_time() {
+  struct timeval time;
+  if (gettimeofday(&time,NULL)){
+    //  Handle error
+    return 0;
+  }
+  return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
+
+int main() {
+  using route = radix_cpp::bit_prefix<uint32_t>;
+  using table = radix_cpp::Table<route, uint32_t, 1>;
+  std::cout << "n;queries;single;batched;check\n";
+  for (size_t n = 100000; n <= 1600000; n *= 2) {
+    auto rng = std::mt19937 {};
+    table R;
+    for (size_t i = 0; i < n; i++) {
+      R[route(static_cast<uint32_t>(rng()), 8 + rng() % 17)] = static_cast<uint32_t>(i);
+    }
+    std::vector<route> queries;
+    for (size_t i = 0; i < 1000000; i++) queries.push_back(route(static_cast<uint32_t>(rng()), 32));
+
+    size_t check = 0;
+    auto t0 = get_wall_time();
+    for (auto & q : queries) {
+      auto it = R.longest_prefix_match(q);
+      if (it != R.end()) check += it->second;
+    }
+    auto t1 = get_wall_time();
+    std::vector<table::iterator> results;
+    results.reserve(queries.size());
+    R.longest_prefix_match(queries.begin(), queries.end(), std::back_inserter(results));
+    for (auto & it : results) {
+      if (it != R.end()) check -= it->second;
+    }
+    auto t2 = get_wall_time();
+
+    std::cout << n << ";" << queries.size() << ";" << t1 - t0 << ";" << t2 - t1 << ";" << check << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,63 @@
+#include <radix_cpp.h>
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+
+#include <sys/time.h>
+#include <time.h>
+
+// inserts, iterates, finds and erases long string keys that only share a short prefix, so that
+// most of each key is a compressed path
+
+static std::vector<std::string> make_test_data(size_t n, size_t length) {
+  std::vector<std::string> v;
+  auto rng = std::mt19937_64 {};
+  for (size_t i = 0; i < n; i++) {
+    std::string s = "/data/warehouse/tables/";
+    while (s.size() < length) s += static_cast<char>('a' + rng() % 26);
+    v.push_back(std::move(s));
+  }
+  return v;
+}
+
+static double get_wall_time() {
+  struct timeval time;
+  if (gettimeofday(&time,NULL)){
+    //  Handle error
+    return 0;
+  }
+  return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
+
+int main() {
+  std::cout << "n;key length;insert;iterate;find;erase;checksum;found\n";
+  for (size_t n = 100000; n <= 400000; n *= 2) {
+    auto v = make_test_data(n, 120);
+    radix_cpp::set<std::string> S;
+    auto t0 = get_wall_time();
+    for (auto & a : v) {
+      S.insert(a);
+    }
+    auto t1 = get_wall_time();
+    size_t sum = 0;
+    for (auto & a : S) {
+      sum += static_cast<uint8_t>(a.back());
+    }
+    auto t2 = get_wall_time();
+    size_t found = 0;
+    for (auto & a : v) {
+      found += S.count(a);
+    }
+    auto t3 = get_wall_time();
+    for (size_t i = 0; i < v.size(); i += 2) {
+      S.erase(v[i]);
+    }
+    auto t4 = get_wall_time();
+
+    std::cout << n << ";120;" << t1 - t0 << ";" << t2 - t1 << ";" << t3 - t2 << ";" << t4 - t3 << ";" << sum % 10 << ";" << found << std::endl;
+  }
+  return 0;
+}
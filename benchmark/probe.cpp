@@ -0,0 +1,61 @@
+#include <radix_cpp.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <string>
+#include <algorithm>
+
+#include <sys/time.h>
+#include <time.h>
+
+// measures the lookups of present and missing keys, which probe the control bytes of the node array
+
+static double get_wall_time() {
+  struct timeval time;
+  if (gettimeofday(&time,NULL)){
+    //  Handle error
+    return 0;
+  }
+  return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
+
+template <typename T, typename Gen>
+static void run(const char * name, size_t n, Gen gen) {
+  auto rng = std::mt19937_64 {};
+  std::vector<T> present, missing;
+  for (size_t i = 0; i < n; i++) present.push_back(gen(rng));
+  for (size_t i = 0; i < n; i++) missing.push_back(gen(rng));
+
+  radix_cpp::set<T> S;
+  auto t0 = get_wall_time();
+  for (auto & a : present) {
+    S.insert(a);
+  }
+  auto t1 = get_wall_time();
+  std::shuffle(std::begin(present), std::end(present), rng);
+  size_t found = 0;
+  auto t2 = get_wall_time();
+  for (auto & a : present) {
+    found += S.count(a);
+  }
+  auto t3 = get_wall_time();
+  for (auto & a : missing) {
+    found += S.count(a);
+  }
+  auto t4 = get_wall_time();
+
+  std::cout << name << ";" << n << ";" << t1 - t0 << ";" << t3 - t2 << ";" << t4 - t3 << ";" << found << std::endl;
+}
+
+int main() {
+  std::cout << "type;n;insert;find present;find missing;found\n";
+  for (size_t n = 1000000; n <= 4000000; n *= 2) {
+    run<uint64_t>("uint64 sparse", n, [](auto & rng) { return static_cast<uint64_t>(rng()); });
+    run<uint32_t>("uint32 sparse", n, [](auto & rng) { return static_cast<uint32_t>(rng()); });
+    run<std::string>("string", n / 2, [](auto & rng) {
+	return "user/" + std::to_string(rng() % 100000000) + "/item/" + std::to_string(rng() % 1000);
+      });
+  }
+  return 0;
+}
@@ -0,0 +1,51 @@
+#include <radix_cpp.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <iterator>
+
+#include <sys/time.h>
+#include <time.h>
+
+// compares rank() and nth() with counting the position of a key by iterating
+
+static double get_wall_time() {
+  struct timeval time;
+  if (gettimeofday(&time,NULL)){
+    //  Handle error
+    return 0;
+  }
+  return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
+
+int main() {
+  std::cout << "n;queries;rank;nth;distance;check\n";
+  for (size_t n = 100000; n <= 1600000; n *= 2) {
+    auto rng = std::mt19937 {};
+    radix_cpp::set<uint32_t> S;
+    for (size_t i = 0; i < n; i++) {
+      S.insert(static_cast<uint32_t>(rng()));
+    }
+    std::vector<uint32_t> queries;
+    for (size_t i = 0; i < 1000; i++) queries.push_back(static_cast<uint32_t>(rng()));
+
+    size_t check = 0;
+    auto t0 = get_wall_time();
+    for (auto & q : queries) {
+      check += S.rank(q);
+    }
+    auto t1 = get_wall_time();
+    for (size_t i = 0; i < queries.size(); i++) {
+      check += *S.nth(i * S.size() / queries.size()) & 1;
+    }
+    auto t2 = get_wall_time();
+    for (size_t i = 0; i < 10; i++) {
+      check -= static_cast<size_t>(std::distance(S.begin(), S.upper_bound(queries[i] - 1)));
+    }
+    auto t3 = get_wall_time();
+
+    std::cout << n << ";" << queries.size() << ";" << t1 - t0 << ";" << t2 - t1 << ";" << (t3 - t2) * 100 << ";" << check << std::endl;
+  }
+  return 0;
+}
@@ -0,0 +1,33 @@
+#include <radix_cpp.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <cstdlib>
+
+// measures the time of a full rehash with a varying number of threads, up to the count given as the argument
+// (by default only the serial rehash)
+
+static std::vector<uint32_t> make_test_data(size_t n) {
+  std::vector<uint32_t> v;
+  auto rng = std::mt19937 {};
+  for (size_t i = 0; i < n; i++) v.push_back(static_cast<uint32_t>(rng()));
+  return v;
+}
+
+int main(int argc, char ** argv) {
+  size_t max_threads = argc > 1 ? static_cast<size_t>(std::max(1, std::atoi(argv[1]))) : 1;
+  std::cout << "n;threads;rehash (s)\n";
+  for (size_t n = 1000000; n <= 4000000; n *= 2) {
+    auto v = make_test_data(n);
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+      radix_cpp::set<uint32_t> S(v.begin(), v.end());
+      auto t0 = std::chrono::steady_clock::now();
+      S.rehash(8 * n, threads);
+      auto t1 = std::chrono::steady_clock::now();
+      std::cout << n << ";" << threads << ";" << std::chrono::duration<double>(t1 - t0).count() << std::endl;
+    }
+  }
+  return 0;
+}
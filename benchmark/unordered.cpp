@@ -0,0 +1,55 @@
+#include <radix_cpp.h>
+
+#include <iostream>
+#include <vector>
+#include <random>
+
+#include <sys/time.h>
+#include <time.h>
+
+// compares summing the values in order with the unordered iteration and for_each_unordered()
+
+static double get_wall_time() {
+  struct timeval time;
+  if (gettimeofday(&time,NULL)){
+    //  Handle error
+    return 0;
+  }
+  return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
+
+int main() {
+  std::cout << "type;n;ordered;unordered;for_each;check\n";
+  for (size_t n = 1000000; n <= 8000000; n *= 2) {
+    auto rng = std::mt19937 {};
+    radix_cpp::set<uint32_t> S;
+    radix_cpp::map<uint64_t, uint64_t> M;
+    for (size_t i = 0; i < n; i++) {
+      auto key = rng();
+      S.insert(static_cast<uint32_t>(key));
+      M[(static_cast<uint64_t>(key) << 32) | rng()] = i;
+    }
+
+    uint64_t check = 0;
+    auto t0 = get_wall_time();
+    for (auto key : S) check += key;
+    auto t1 = get_wall_time();
+    for (auto it = S.unordered_begin(); it != S.unordered_end(); ++it) check -= *it;
+    auto t2 = get_wall_time();
+    S.for_each_unordered([&](uint32_t key) { check += key; });
+    auto t3 = get_wall_time();
+    for (auto it = S.unordered_begin(); it != S.unordered_end(); ++it) check -= *it;
+    std::cout << "set<uint32_t>;" << n << ";" << t1 - t0 << ";" << t2 - t1 << ";" << t3 - t2 << ";" << check << std::endl;
+
+    t0 = get_wall_time();
+    for (auto & [ key, value ] : M) check += value;
+    t1 = get_wall_time();
+    for (auto it = M.unordered_begin(); it != M.unordered_end(); ++it) check -= it->second;
+    t2 = get_wall_time();
+    M.for_each_unordered([&](const std::pair<uint64_t, uint64_t> & kv) { check += kv.second; });
+    t3 = get_wall_time();
+    for (auto it = M.unordered_begin(); it != M.unordered_end(); ++it) check -= it->second;
+    std::cout << "map<uint64_t, uint64_t>;" << n << ";" << t1 - t0 << ";" << t2 - t1 << ";" << t3 - t2 << ";" << check << std::endl;
+  }
+  return 0;
+}
@@ -2,10 +2,49 @@
 #define _RADIXCPP_H_
 
 #include <cstdint>
+#include <cstddef>
 #include <utility>
 #include <string>
+#include <string_view>
 #include <stdexcept>
 #include <tuple>
+#include <algorithm>
+#include <iterator>
+#include <vector>
+#include <array>
+#include <thread>
+#include <system_error>
+#include <cstring>
+#include <cstdio>
+#include <cerrno>
+#include <memory>
+#include <chrono>
+
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define RADIX_CPP_PMR
+#endif
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// the control bytes are tested with AVX2 or SSE2 if available, unless RADIX_CPP_NO_SIMD is defined
+#if !defined(RADIX_CPP_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define RADIX_CPP_AVX2
+#elif !defined(RADIX_CPP_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define RADIX_CPP_SSE2
+#endif
 
 #ifdef DEBUG
 #include <iostream>
@@ -85,6 +124,95 @@ namespace radix_cpp {
     return key.size();
   }
 
+  // string_view (for lookups)
+
+  inline std::pair<size_t, std::string_view> deconstruct(std::string_view key) noexcept {
+    if (key.empty()) {
+      return std::pair(0, key);
+    } else {
+      auto ord = static_cast<uint8_t>(key.back());
+      key.remove_suffix(1);
+      return std::pair(ord, key);
+    }
+  }
+
+  inline size_t keysize(std::string_view key) noexcept {
+    return key.size();
+  }
+
+  // bit prefixes
+
+  // bit_prefix is a key of variable bit length, such as a CIDR block: the length most significant bits of
+  // an unsigned integer. The bits below the length are cleared. The keys are ordered as in the tree, so that
+  // a prefix precedes the keys that it is a prefix of. The length must be a multiple of the digit width,
+  // so 1-bit digits are needed for arbitrary lengths: other keys are rejected with std::invalid_argument, and
+  // aren't found by find().
+  template <typename T>
+  struct bit_prefix {
+    static_assert(std::is_unsigned<T>::value, "bit prefixes require an unsigned integer type");
+    static constexpr size_t max_length = 8 * sizeof(T);
+
+    bit_prefix() noexcept : bits(0), length(0) { }
+    bit_prefix(T bits0, size_t length0) noexcept
+      : bits(length0 ? static_cast<T>(bits0 >> (max_length - length0) << (max_length - length0)) : 0),
+	length(static_cast<uint8_t>(length0)) { }
+
+    bool operator==(const bit_prefix & other) const noexcept { return bits == other.bits && length == other.length; }
+    bool operator!=(const bit_prefix & other) const noexcept { return !(*this == other); }
+    bool operator<(const bit_prefix & other) const noexcept {
+      auto n = std::min(length, other.length);
+      auto a = n ? bits >> (max_length - n) : 0, b = n ? other.bits >> (max_length - n) : 0;
+      return a < b || (a == b && length < other.length);
+    }
+
+    T bits;
+    uint8_t length;
+  };
+
+  // append_bits and deconstruct_bits split a bit prefix into digits of any width
+  template<size_t Bits, typename T>
+  bit_prefix<T> append_bits(bit_prefix<T> key, size_t digit) noexcept {
+    auto shift = bit_prefix<T>::max_length - key.length - Bits;
+    return bit_prefix<T>(static_cast<T>(key.bits | (static_cast<T>(digit) << shift)), key.length + Bits);
+  }
+
+  template<size_t Bits, typename T>
+  std::pair<size_t, bit_prefix<T>> deconstruct_bits(const bit_prefix<T> & key) noexcept {
+    if (!key.length) return std::pair(0, key);
+    auto shift = bit_prefix<T>::max_length - key.length;
+    return std::pair(static_cast<size_t>((key.bits >> shift) & ((size_t(1) << Bits) - 1)), bit_prefix<T>(key.bits, key.length - Bits));
+  }
+
+  template<typename T>
+  bit_prefix<T> append(bit_prefix<T> key, size_t digit) noexcept {
+    return append_bits<8>(key, digit);
+  }
+
+  template<typename T>
+  std::pair<size_t, bit_prefix<T>> deconstruct(const bit_prefix<T> & key) noexcept {
+    return deconstruct_bits<8>(key);
+  }
+
+  template<typename T>
+  size_t keysize(const bit_prefix<T> & key) noexcept {
+    return key.length / 8;
+  }
+
+  // is_prefix returns true if the first key is a prefix of the second. Fixed size keys are only prefixes of themselves.
+  inline bool is_prefix(std::string_view prefix, std::string_view key) noexcept {
+    return prefix.size() <= key.size() && key.substr(0, prefix.size()) == prefix;
+  }
+
+  template<typename T>
+  bool is_prefix(const bit_prefix<T> & prefix, const bit_prefix<T> & key) noexcept {
+    return prefix.length <= key.length && bit_prefix<T>(key.bits, prefix.length) == prefix;
+  }
+
+  template<typename T, typename std::enable_if<std::is_arithmetic<T>::value>::type* = nullptr>
+  bool is_prefix(T prefix, T key) noexcept {
+    return prefix == key;
+  }
+
   // uint8_t
   
   inline uint8_t append(uint8_t key, size_t digit) noexcept {
@@ -112,6 +240,82 @@ namespace radix_cpp {
     return sizeof(key);
   }
 
+  // Digit width
+
+  // digit_bits selects the width of the digits. The functions above split the keys into 8-bit digits,
+  // and the other widths are derived from them by regrouping the bits of the unsigned prefix key.
+  // This only works for keys whose prefix key is an unsigned integer, i.e. the arithmetic types.
+  template <size_t Bits>
+  struct digit_bits {
+    static_assert(Bits == 1 || Bits == 2 || Bits == 4 || Bits == 8 || Bits == 16, "the digit width must be a power of two up to 16 bits");
+    static constexpr size_t mask = (size_t(1) << Bits) - 1;
+  };
+
+  template<typename K>
+  auto append(K key, size_t digit, digit_bits<8>) {
+    return append(std::move(key), digit);
+  }
+
+  template<typename K>
+  auto deconstruct(K key, digit_bits<8>) {
+    return deconstruct(std::move(key));
+  }
+
+  template<typename K>
+  size_t keysize(const K & key, digit_bits<8>) {
+    return keysize(key);
+  }
+
+  template<typename K, size_t Bits, typename std::enable_if<Bits != 8>::type* = nullptr>
+  K append(K key, size_t digit, digit_bits<Bits>) noexcept {
+    static_assert(std::is_unsigned<K>::value, "digit widths other than 8 bits require unsigned prefix keys");
+    return static_cast<K>((static_cast<uint64_t>(key) << Bits) | digit);
+  }
+
+  template<typename K, size_t Bits, typename std::enable_if<Bits != 8>::type* = nullptr>
+  auto deconstruct(const K & key, digit_bits<Bits>) noexcept {
+    auto [ ordinal, prefix_key ] = deconstruct(key);
+    using P = decltype(prefix_key);
+    static_assert(std::is_unsigned<P>::value, "digit widths other than 8 bits require unsigned prefix keys");
+    // the 8-bit split is undone, and the bits are split again at the requested width
+    uint64_t code = (static_cast<uint64_t>(prefix_key) << 8) | ordinal;
+    return std::pair<size_t, P>(static_cast<size_t>(code & digit_bits<Bits>::mask), static_cast<P>(code >> Bits));
+  }
+
+  template<typename K, size_t Bits, typename std::enable_if<Bits != 8>::type* = nullptr>
+  size_t keysize(const K & key, digit_bits<Bits>) noexcept {
+    return (keysize(key) * 8 + Bits - 1) / Bits;
+  }
+
+  // bit prefixes are split at other widths directly, since their prefix keys aren't integers
+
+  template<typename T, size_t Bits, typename std::enable_if<Bits != 8>::type* = nullptr>
+  bit_prefix<T> append(bit_prefix<T> key, size_t digit, digit_bits<Bits>) noexcept {
+    return append_bits<Bits>(key, digit);
+  }
+
+  template<typename T, size_t Bits, typename std::enable_if<Bits != 8>::type* = nullptr>
+  std::pair<size_t, bit_prefix<T>> deconstruct(const bit_prefix<T> & key, digit_bits<Bits>) noexcept {
+    return deconstruct_bits<Bits>(key);
+  }
+
+  template<typename T, size_t Bits, typename std::enable_if<Bits != 8>::type* = nullptr>
+  size_t keysize(const bit_prefix<T> & key, digit_bits<Bits>) noexcept {
+    return key.length / Bits;
+  }
+
+  // is_whole_digits returns false if the key doesn't split into whole digits of the width, which only happens
+  // for bit prefixes whose length isn't a multiple of it
+  template<typename K, size_t Bits>
+  bool is_whole_digits(const K &, digit_bits<Bits>) noexcept {
+    return true;
+  }
+
+  template<typename T, size_t Bits>
+  bool is_whole_digits(const bit_prefix<T> & key, digit_bits<Bits>) noexcept {
+    return key.length % Bits == 0;
+  }
+
   /* MurmurHash3 was written by Austin Appleby, and is placed in the public domain.
      The author(s) hereby disclaim copyright to the MurmurHash3 source code.
   */
@@ -178,82 +382,600 @@ namespace radix_cpp {
     return h1;
   }
 
-  template <typename Key, typename T>
+  // multiplies two 64 bit numbers and folds the 128 bit product by xoring its halves, as in wyhash
+  inline uint64_t mum(uint64_t a, uint64_t b) noexcept {
+#if defined(__SIZEOF_INT128__)
+    auto r = static_cast<unsigned __int128>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    uint64_t hi;
+    uint64_t lo = _umul128(a, b, &hi);
+    return lo ^ hi;
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = static_cast<uint32_t>(a), lb = static_cast<uint32_t>(b);
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32), c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    return lo ^ hi;
+#endif
+  }
+
+  // Hash policies
+
+  // A hash policy calculates the hash of a Node from its depth, the polynomial hash of its prefix key and its
+  // ordinal. calc_unordered_hash combines the depth and the prefix hash, and calc_final_hash adds the ordinal,
+  // so that the children of a Node can be hashed with one call each. The low bits of the final hash select
+  // the slot and the seven high bits go to the control byte, so both ends have to be well mixed.
+
+  // murmur3_hash mixes with the Murmur3 operations. It is the default.
+  struct murmur3_hash {
+    static size_t calc_unordered_hash(size_t depth, size_t prefix_hash) noexcept {
+      auto k1 = murmur3_mix_k1(prefix_hash);
+      return murmur3_mix_h1(depth, k1);
+    }
+
+    static size_t calc_final_hash(size_t h1, size_t ordinal) noexcept {
+      auto k1 = murmur3_mix_k1(ordinal);
+      h1 = murmur3_mix_h1(h1, k1);
+      return murmur3_fmix(h1);
+    }
+  };
+
+  // multiplicative_hash needs one multiplication per Node, and the high half of the product is folded into
+  // the low half for the slot. It is meant for integer keys, whose prefix hashes are already distinct.
+  struct multiplicative_hash {
+    static constexpr size_t multiplier = static_cast<size_t>(UINT64_C(0xd6e8feb86659fd93));
+    static constexpr size_t half = sizeof(size_t) * 4;
+
+    static size_t calc_unordered_hash(size_t depth, size_t prefix_hash) noexcept {
+      return (prefix_hash ^ (depth << (2 * half - 8))) * multiplier;
+    }
+
+    static size_t calc_final_hash(size_t h0, size_t ordinal) noexcept {
+      auto h = (h0 + ordinal + 1) * multiplier;
+      return h ^ (h >> half);
+    }
+  };
+
+  // wyhash_hash mixes with the folded 128 bit products of wyhash, which are well mixed at both ends.
+  // It is meant for string keys, whose prefix hashes are long polynomials of the characters.
+  struct wyhash_hash {
+    static constexpr uint64_t secret0 = UINT64_C(0xa0761d6478bd642f), secret1 = UINT64_C(0xe7037ed1a0b428db);
+    static constexpr uint64_t secret2 = UINT64_C(0x8ebc6af09c88c6e3), secret3 = UINT64_C(0x589965cc75374cc3);
+
+    static size_t calc_unordered_hash(size_t depth, size_t prefix_hash) noexcept {
+      return static_cast<size_t>(mum(prefix_hash ^ secret0, depth ^ secret1));
+    }
+
+    static size_t calc_final_hash(size_t h0, size_t ordinal) noexcept {
+      return static_cast<size_t>(mum(h0 ^ secret2, ordinal ^ secret3));
+    }
+  };
+
+  // calculates the inverse of an odd number modulo 2^n using Newton's method
+  constexpr size_t calc_multiplicative_inverse(size_t a) noexcept {
+    size_t x = a;
+    for (int i = 0; i < 5; i++) {
+      x *= 2 - a * x;
+    }
+    return x;
+  }
+
+  // bit manipulation helpers
+
+  inline size_t countr_zero(uint64_t x) noexcept {
+#ifdef _MSC_VER
+    unsigned long r;
+    _BitScanForward64(&r, x);
+    return static_cast<size_t>(r);
+#else
+    return static_cast<size_t>(__builtin_ctzll(x));
+#endif
+  }
+
+  inline size_t popcount(uint64_t x) noexcept {
+#ifdef _MSC_VER
+    return static_cast<size_t>(__popcnt64(x));
+#else
+    return static_cast<size_t>(__builtin_popcountll(x));
+#endif
+  }
+
+  inline size_t countl_zero(uint64_t x) noexcept {
+#ifdef _MSC_VER
+    unsigned long r;
+    _BitScanReverse64(&r, x);
+    return 63 - static_cast<size_t>(r);
+#else
+    return static_cast<size_t>(__builtin_clzll(x));
+#endif
+  }
+
+  // atomically replaces *p with desired if it equals expected, and returns true if it did
+  inline bool compare_and_swap(uint64_t * p, uint64_t expected, uint64_t desired) noexcept {
+#ifdef _MSC_VER
+    auto e = static_cast<__int64>(expected);
+    return _InterlockedCompareExchange64(reinterpret_cast<volatile __int64*>(p), static_cast<__int64>(desired), e) == e;
+#else
+    return __atomic_compare_exchange_n(p, &expected, desired, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+#endif
+  }
+
+  // Each slot of the node array has a control byte: zero if the slot is empty, one for a tombstone, and
+  // otherwise the high bit and seven bits of the hash. A ControlGroup tests a group of consecutive control
+  // bytes at once. The bit masks have one bit per matching byte, and index() returns the lowest one.
+#if defined(RADIX_CPP_AVX2)
+  struct ControlGroup {
+    static constexpr size_t width = 32;
+    explicit ControlGroup(const uint8_t * p) noexcept : v_(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))) { }
+    uint64_t match(uint8_t c) const noexcept {
+      return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v_, _mm256_set1_epi8(static_cast<char>(c)))));
+    }
+    uint64_t match_free() const noexcept { return static_cast<uint32_t>(~_mm256_movemask_epi8(v_)); }
+    static size_t index(uint64_t m) noexcept { return countr_zero(m); }
+    __m256i v_;
+  };
+#elif defined(RADIX_CPP_SSE2)
+  struct ControlGroup {
+    static constexpr size_t width = 16;
+    explicit ControlGroup(const uint8_t * p) noexcept : v_(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) { }
+    uint64_t match(uint8_t c) const noexcept {
+      return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(v_, _mm_set1_epi8(static_cast<char>(c)))));
+    }
+    uint64_t match_free() const noexcept { return ~static_cast<uint32_t>(_mm_movemask_epi8(v_)) & 0xffff; }
+    static size_t index(uint64_t m) noexcept { return countr_zero(m); }
+    __m128i v_;
+  };
+#else
+  // the scalar version tests eight bytes packed in an integer. match() can also report a byte just above a
+  // matching one, which is harmless, since the candidates are compared anyway and an empty slot exists below.
+  struct ControlGroup {
+    static constexpr size_t width = 8;
+    static constexpr uint64_t lsbs = UINT64_C(0x0101010101010101), msbs = UINT64_C(0x8080808080808080);
+    explicit ControlGroup(const uint8_t * p) noexcept {
+      for (size_t i = 0; i < width; i++) v_ |= static_cast<uint64_t>(p[i]) << (8 * i);
+    }
+    uint64_t match(uint8_t c) const noexcept {
+      auto x = v_ ^ (lsbs * c);
+      return (x - lsbs) & ~x & msbs;
+    }
+    uint64_t match_free() const noexcept { return ~v_ & msbs; }
+    static size_t index(uint64_t m) noexcept { return countr_zero(m) >> 3; }
+    uint64_t v_ = 0;
+  };
+#endif
+
+  // NUMA placement of the memory of a huge_page_allocator: the default of the thread, interleaved
+  // over the nodes page by page, or bound to the nodes
+  enum class numa_policy { local, interleave, bind };
+
+  // huge_page_allocator maps large blocks, such as big node arrays, with mmap and advises the kernel to back them
+  // with transparent huge pages, which reduces the TLB misses of the random probes. The blocks are aligned to the
+  // huge pages, and they can be interleaved or bound across NUMA nodes (given as a bit mask, or all allowed nodes
+  // if zero). The NUMA policy is a hint, and it is ignored if the kernel rejects it. Smaller blocks, and all blocks
+  // on other systems than Linux, are allocated with calloc. All the memory is zero-filled.
+  template <typename T>
+  class huge_page_allocator {
+  public:
+    using value_type = T;
+    static constexpr bool zeroes_memory = true;
+    static constexpr size_t huge_page_size = size_t(1) << 21;
+    static constexpr size_t min_mapped_size = huge_page_size; // the smallest block that is mapped
+
+    huge_page_allocator() noexcept { }
+    explicit huge_page_allocator(numa_policy policy, uint64_t nodes = 0) noexcept : policy_(policy), nodes_(nodes) { }
+    template <typename U>
+    huge_page_allocator(const huge_page_allocator<U> & other) noexcept : policy_(other.get_policy()), nodes_(other.get_nodes()) { }
+
+    T * allocate(size_t n) {
+      size_t bytes = n * sizeof(T);
+#ifdef __linux__
+      if (bytes >= min_mapped_size) {
+	// map an extra huge page, and unmap the unaligned ends
+	size_t size = get_mapped_size(bytes);
+	auto p = static_cast<char *>(mmap(nullptr, size + huge_page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (p == MAP_FAILED) throw std::bad_alloc();
+	auto head = (huge_page_size - reinterpret_cast<uintptr_t>(p) % huge_page_size) % huge_page_size;
+	if (head) munmap(p, head);
+	munmap(p + head + size, huge_page_size - head);
+	p += head;
+#ifdef MADV_HUGEPAGE
+	madvise(p, size, MADV_HUGEPAGE);
+#endif
+	if (policy_ != numa_policy::local) set_numa_policy(p, size);
+	return reinterpret_cast<T *>(p);
+      }
+#endif
+      auto p = std::calloc(1, bytes);
+      if (!p) throw std::bad_alloc();
+      return static_cast<T *>(p);
+    }
+
+    void deallocate(T * p, size_t n) noexcept {
+#ifdef __linux__
+      size_t bytes = n * sizeof(T);
+      if (bytes >= min_mapped_size) {
+	munmap(p, get_mapped_size(bytes));
+	return;
+      }
+#endif
+      std::free(p);
+    }
+
+    numa_policy get_policy() const noexcept { return policy_; }
+    uint64_t get_nodes() const noexcept { return nodes_; }
+
+    // the memory can be released by any instance, whatever its policy
+    template <typename U>
+    bool operator==(const huge_page_allocator<U> &) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const huge_page_allocator<U> &) const noexcept { return false; }
+
+  private:
+    static size_t get_mapped_size(size_t bytes) noexcept {
+      return (bytes + huge_page_size - 1) / huge_page_size * huge_page_size;
+    }
+
+#ifdef __linux__
+    void set_numa_policy(void * p, size_t size) const noexcept {
+#if defined(SYS_mbind) && defined(SYS_get_mempolicy)
+      constexpr int mpol_bind = 2, mpol_interleave = 3, mpol_f_mems_allowed = 4;
+      constexpr unsigned long max_node = 65; // the kernel reads one bit less than given
+      unsigned long nodes = static_cast<unsigned long>(nodes_);
+      if (!nodes && syscall(SYS_get_mempolicy, nullptr, &nodes, max_node, nullptr, mpol_f_mems_allowed) != 0) return;
+      syscall(SYS_mbind, p, size, policy_ == numa_policy::bind ? mpol_bind : mpol_interleave, &nodes, max_node, 0);
+#endif
+    }
+#endif
+
+    numa_policy policy_ = numa_policy::local;
+    uint64_t nodes_ = 0; // the NUMA nodes as a bit mask, or zero for all allowed nodes
+  };
+
+  // the node arrays of tables that use std::allocator are allocated with calloc, and cleared lazily by the OS
+  template <typename A> struct is_std_allocator : std::false_type { };
+  template <typename T> struct is_std_allocator<std::allocator<T>> : std::true_type { };
+
+  // the memory of an allocator whose zeroes_memory is true is known to be zero-filled, and isn't cleared again
+  template <typename A, typename = void> struct zeroes_memory : std::false_type { };
+  template <typename A> struct zeroes_memory<A, std::void_t<decltype(A::zeroes_memory)>> : std::integral_constant<bool, A::zeroes_memory> { };
+
+  // Table is the radix tree behind set and map, with digits of DigitBits bits. Every interior Node has a Level with
+  // a 2^DigitBits-bit occupancy bitmap: 32 bytes with 8-bit digits, but 8 KB with 16-bit digits, so 16-bit digits
+  // only pay off if the interior Nodes have many children.
+  template <typename Key, typename T, size_t DigitBits = 8, typename Hash = murmur3_hash,
+	    typename Allocator = std::allocator<typename std::conditional<std::is_void<T>::value, Key, std::pair<Key, T>>::type>>
   class Table {
   public:
     static constexpr bool is_map = !std::is_void<T>::value;
     static constexpr bool is_set = !is_map;
-    static constexpr size_t bucket_count = 256; // bucket count for the ordered portion of the key
+    static constexpr size_t digit_width = DigitBits; // the number of bits in a digit of the key
+    static constexpr size_t bucket_count = size_t(1) << DigitBits; // bucket count for the ordered portion of the key
     static constexpr size_t min_load_factor100 = 15;
-    static constexpr size_t max_load_factor100 = 60;
+    static constexpr size_t max_load_factor100 = 80;
+    static constexpr size_t max_tombstone_factor100 = 15; // the tombstones are purged when they exceed this share of the slots
+    static constexpr size_t default_keysize = 16; // assumed number of digits in variable length keys
 
     using key_type = Key;
-    using internal_key_type = decltype(deconstruct(Key{}).second);
+    using digits = digit_bits<DigitBits>; // the digit width passed to deconstruct, append and keysize
+    using internal_key_type = decltype(deconstruct(Key{}, digits{}).second);
     using mapped_type = T;
     using value_type = typename std::conditional<is_set, Key, std::pair<Key, T>>::type;
     using size_type = size_t;
-    using Self = Table<key_type, mapped_type>;
+    using hasher = Hash; // the hash policy for the Nodes
+    using allocator_type = Allocator; // rebound for the node arrays, the Arena, the Levels and their free lists
+    using Self = Table<key_type, mapped_type, DigitBits, Hash, Allocator>;
+
+    // string keys can be looked up with anything that converts to std::string_view, such as const char *
+    static constexpr bool is_string_key = std::is_convertible<const internal_key_type &, std::string_view>::value;
+    template <typename K>
+    using is_lookup_key = std::integral_constant<bool, is_string_key && std::is_convertible<const K &, std::string_view>::value>;
 
   private:
+    template <typename U>
+    using rebind_alloc = typename std::allocator_traits<Allocator>::template rebind_alloc<U>;
+
+    static constexpr uint32_t root_level = 0;
+    static constexpr uint32_t no_level = UINT32_MAX;
+    static constexpr size_t duplicate_key = SIZE_MAX;
+    static constexpr size_t migration_step = 32; // slots moved per insert or erase during an incremental resize
+    static constexpr size_t parallel_rehash_min_nodes = 65536; // smallest share of the node array worth a thread
+    static constexpr size_t lookup_batch_size = 16; // keys prefetched at once by batched lookups
+
+    // String prefix keys are not stored in the Nodes at all. A compact Node has the Level containing it and
+    // the full hash instead, and the prefix is compared by following the owners of the Levels towards the root.
+    static constexpr bool compact_nodes = is_string_key;
+
+    // The Nodes of the first digit are stored in a directly indexed array, unless the digits are so wide that
+    // the array would be too large for small tables
+    static constexpr bool direct_top = bucket_count <= 256;
+
+    static constexpr uint8_t ctrl_empty = 0, ctrl_tombstone = 1;
+    static constexpr size_t direct_probe_slots = 2; // slots probed without the control bytes
+
+    // The keys of sets of numbers are stored in the Nodes in place of the payload pointer, and the Arena isn't used.
+    // The iterators of such sets hold a copy of the key. Map values stay in the Arena, since the head of a
+    // compressed path and its final Node share the value, and it can be modified.
+    static constexpr bool inline_payload = is_set && std::is_arithmetic<Key>::value && sizeof(Key) <= sizeof(void*);
+    using InlineValue = typename std::conditional<inline_payload, value_type, char>::type; // unused for other tables
+
+    union InlinePayload {
+      value_type * ptr_; // null, or the tombstone mark
+      value_type value_;
+    };
+
+    struct NodeTail {
+      uint32_t children_;
+      internal_key_type prefix_key_;
+    };
+
+    struct CompactNodeTail {
+      uint32_t children_;
+      uint32_t parent_;
+      size_t hash_;
+    };
+
     struct Node {
-      void set_payload(value_type * payload) { payload_ = payload; }
-      value_type * get_payload() { return payload_; }
-      const value_type * get_payload() const { return payload_; }
+      // sets the payload pointer, or copies the value of an inline payload
+      void set_payload(value_type * payload) {
+	if constexpr (inline_payload) {
+	  if (payload) {
+	    payload_.ptr_ = nullptr;
+	    payload_.value_ = *payload;
+	    combined_ |= value_flag;
+	  } else {
+	    combined_ &= ~value_flag;
+	  }
+	} else {
+	  payload_ = payload;
+	}
+      }
+      value_type * get_payload() {
+	if constexpr (inline_payload) {
+	  return combined_ & value_flag ? &payload_.value_ : nullptr;
+	} else {
+	  return payload_;
+	}
+      }
+      const value_type * get_payload() const { return const_cast<Node *>(this)->get_payload(); }
       bool is_assigned() const { return combined_ != 0; }
-      bool is_tombstone() const { return payload_ == reinterpret_cast<value_type*>(1); }
-      size_t get_depth_lsb() const { return (combined_ >> 8) & 0xff; }
-      const internal_key_type & get_prefix_key() const { return prefix_key_; }
-      size_t get_ordinal() const { return combined_ & 0xff; }
-      size_t get_value_count() const { return combined_ >> 16; }
+      bool is_tombstone() const {
+	if constexpr (inline_payload) {
+	  return !combined_ && raw_payload() == reinterpret_cast<value_type*>(1);
+	} else {
+	  return payload_ == reinterpret_cast<value_type*>(1);
+	}
+      }
+      size_t get_depth_lsb() const { return (combined_ >> depth_shift) & 0xff; }
+      const internal_key_type & get_prefix_key() const { return tail_.prefix_key_; } // not for compact Nodes
+      size_t get_ordinal() const { return combined_ & digits::mask; }
+      size_t get_value_count() const { return combined_ >> count_shift; }
+      // a head holds the payload of the only key below it, whose path has been compressed
+      bool is_head() const { return combined_ & head_flag; }
+      // a detached Node is the final Node of a compressed path, and its parent doesn't exist
+      bool is_detached() const { return combined_ & detached_flag; }
+      void set_head(bool f) { combined_ = f ? combined_ | head_flag : combined_ & ~head_flag; }
+      void set_detached(bool f) { combined_ = f ? combined_ | detached_flag : combined_ & ~detached_flag; }
+      uint32_t get_children() const { return tail_.children_; }
+      void set_children(uint32_t children) { tail_.children_ = children; }
+
+      size_t get_hash() const {
+	if constexpr (compact_nodes) {
+	  return tail_.hash_;
+	} else {
+	  return 0;
+	}
+      }
+      // the Level containing a compact Node, or no_level if it is detached or hasn't been linked yet
+      uint32_t get_parent() const {
+	if constexpr (compact_nodes) {
+	  return tail_.parent_;
+	} else {
+	  return no_level;
+	}
+      }
+      void set_parent(uint32_t parent) {
+	if constexpr (compact_nodes) {
+	  tail_.parent_ = parent;
+	}
+      }
 
       void reset() {
 	combined_ = 0;
-	payload_ = 0;
+	raw_payload() = nullptr;
+	tail_.children_ = 0;
+      }
+
+      template <typename K>
+      void assign(size_t depth, const K & prefix_key, size_t ordinal, size_t hash) {
+	combined_ = count_unit | ((depth & 0xff) << depth_shift) | ordinal;
+	raw_payload() = nullptr;
+	tail_.children_ = 0;
+	if constexpr (compact_nodes) {
+	  tail_.parent_ = no_level;
+	  tail_.hash_ = hash;
+	} else {
+	  new (static_cast<void*>(&(tail_.prefix_key_))) internal_key_type(prefix_key);
+	}
+      }
+
+      // destroys the prefix key of a Node that is being removed
+      void clear_prefix_key() {
+	if constexpr (!compact_nodes) {
+	  tail_.prefix_key_.~internal_key_type();
+	}
+      }
+      
+      // claims an unassigned slot for a Node moved by a parallel rehash. Only combined_ is written
+      // atomically, since the other threads just need to see that the slot is taken.
+      bool try_claim(const Node & other) {
+	return compare_and_swap(&combined_, 0, other.combined_);
       }
 
-      void assign(size_t depth, internal_key_type prefix_key, size_t ordinal) {
-	new (static_cast<void*>(&(prefix_key_))) internal_key_type(std::move(prefix_key));
-	combined_ = (1 << 16) | ((depth & 0xff) << 8) | ordinal;
-	payload_ = nullptr;
+      // moves the rest of the Node into a claimed slot
+      void move_claimed(Node && other) {
+	payload_ = other.payload_;
+	new (static_cast<void*>(&tail_)) decltype(tail_)(std::move(other.tail_));
       }
       
+      void set_tombstone() {
+	combined_ = 0;
+	raw_payload() = reinterpret_cast<value_type*>(1);
+      }
+
       void inc_value_count() {
-	combined_ += 65536;
+	combined_ += count_unit;
+      }
+
+      void add_value_count(size_t n) {
+	combined_ += static_cast<uint64_t>(n) << count_shift;
       }
 
       bool dec_value_count() {
-	combined_ -= 65536;
-	if (combined_ < 65536) {
+	combined_ -= count_unit;
+	if (combined_ < count_unit) {
 	  combined_ = 0;
-	  payload_ = reinterpret_cast<value_type*>(1); // mark as tombstone
+	  raw_payload() = reinterpret_cast<value_type*>(1); // mark as tombstone
 	  return true;
 	} else {
 	  return false;
 	}
       }
 
-      bool equals(size_t depth, const internal_key_type & prefix_key, size_t ordinal) const {
-	return (combined_ & 0xffff) == (((depth & 0xff) << 8) | ordinal) && prefix_key == prefix_key_;
+      // compares the depth and ordinal, and either the prefix key or the hash of a compact Node. The prefix of
+      // a compact Node with the same hash is compared by the Table.
+      template <typename K>
+      bool equals(size_t depth, const K & prefix_key, size_t ordinal, size_t hash) const {
+	if ((combined_ & (head_flag - 1)) != (((depth & 0xff) << depth_shift) | ordinal)) return false;
+	if constexpr (compact_nodes) {
+	  return tail_.hash_ == hash;
+	} else {
+	  return prefix_key == tail_.prefix_key_;
+	}
       }
 
     private:
-      uint64_t combined_; // from low to high, bits 1-8 = ordinal, 9-16 = lsb of depth, the rest = value count
-      value_type * payload_;
-      internal_key_type prefix_key_;
+      value_type *& raw_payload() {
+	if constexpr (inline_payload) {
+	  return payload_.ptr_;
+	} else {
+	  return payload_;
+	}
+      }
+      value_type * raw_payload() const { return const_cast<Node *>(this)->raw_payload(); }
+
+      static constexpr size_t depth_shift = DigitBits;
+      static constexpr uint64_t head_flag = UINT64_C(1) << (DigitBits + 8);
+      static constexpr uint64_t detached_flag = UINT64_C(1) << (DigitBits + 9);
+      static constexpr uint64_t value_flag = UINT64_C(1) << (DigitBits + 10); // an inline payload is present
+      static constexpr size_t count_shift = DigitBits + 11;
+      static constexpr uint64_t count_unit = UINT64_C(1) << count_shift;
+
+      uint64_t combined_; // from low to high, DigitBits bits of ordinal, 8 bits of lsb of depth, 3 flags, the rest = value count
+      // the payload pointer, or the value itself if the payload is inline
+      typename std::conditional<inline_payload, InlinePayload, value_type *>::type payload_;
+      // the index of the Level holding the children of the node (or zero if there are none), and either
+      // the prefix key or the index of the Level containing the node and the hash
+      typename std::conditional<compact_nodes, CompactNodeTail, NodeTail>::type tail_;
+    };
+
+    // Level is the child-occupancy bitmap of an interior Node (or the root). It allows the
+    // iterator to jump directly to the next present ordinal instead of probing every one.
+    // The bitmap has bucket_count bits, which is 8 KB for 16-bit digits.
+    struct Level {
+      static constexpr size_t num_words = (bucket_count + 63) / 64;
+
+      void reset(uint32_t parent, Node * owner) {
+	for (size_t i = 0; i < num_words; i++) bits_[i] = 0;
+	parent_ = parent;
+	owner_ = owner;
+      }
+
+      void set(size_t ordinal) { bits_[ordinal >> 6] |= UINT64_C(1) << (ordinal & 63); }
+      void unset(size_t ordinal) { bits_[ordinal >> 6] &= ~(UINT64_C(1) << (ordinal & 63)); }
+
+      bool empty() const noexcept {
+	for (size_t i = 0; i < num_words; i++) {
+	  if (bits_[i]) return false;
+	}
+	return true;
+      }
+
+      // returns the smallest present ordinal that is not less than ordinal, or bucket_count if there is none
+      size_t next(size_t ordinal) const noexcept {
+	size_t i = ordinal >> 6;
+	if (i >= num_words) return bucket_count;
+	uint64_t w = bits_[i] & (~UINT64_C(0) << (ordinal & 63));
+	while ( 1 ) {
+	  if (w) return (i << 6) + countr_zero(w);
+	  if (++i == num_words) return bucket_count;
+	  w = bits_[i];
+	}
+      }
+
+      // returns the largest present ordinal that is not greater than ordinal, or bucket_count if there is none
+      size_t prev(size_t ordinal) const noexcept {
+	if (ordinal >= bucket_count) ordinal = bucket_count - 1;
+	size_t i = ordinal >> 6;
+	uint64_t w = bits_[i] & (~UINT64_C(0) >> (63 - (ordinal & 63)));
+	while ( 1 ) {
+	  if (w) return (i << 6) + 63 - countl_zero(w);
+	  if (i-- == 0) return bucket_count;
+	  w = bits_[i];
+	}
+      }
+
+      // returns the number of present ordinals, or those less than ordinal
+      size_t count() const noexcept { return count_below(bucket_count); }
+      size_t count_below(size_t ordinal) const noexcept {
+	size_t n = 0, i = 0;
+	for (; i < num_words && (i << 6) + 64 <= ordinal; i++) n += popcount(bits_[i]);
+	if (i < num_words && (ordinal & 63)) n += popcount(bits_[i] & ((UINT64_C(1) << (ordinal & 63)) - 1));
+	return n;
+      }
+
+      uint32_t get_parent() const noexcept { return parent_; }
+      void set_parent(uint32_t parent) noexcept { parent_ = parent; }
+      Node * get_owner() const noexcept { return owner_; }
+      void set_owner(Node * owner) noexcept { owner_ = owner; }
+
+    private:
+      uint64_t bits_[num_words];
+      uint32_t parent_; // the Level containing the owner Node
+      Node * owner_; // the owner Node, so that the ancestors can be reached without probing
+    };
+
+    // BoundedPath holds the positions of the Nodes on the path of a key of bounded size, and the range [lo, hi]
+    // of depths in which the deepest existing Node is searched. found is the Node at lo, or null if lo is zero.
+    struct BoundedPath {
+      static constexpr size_t max_depth = 8 * sizeof(key_type) + 1;
+      std::array<internal_key_type, max_depth> prefix_keys;
+      std::array<size_t, max_depth> ordinals, prefix_hashes;
+      size_t lo = 0, hi = 0;
+      Node * found = nullptr;
+
+      bool done() const noexcept { return hi - lo <= 1; }
+      size_t mid() const noexcept { return (lo + hi) / 2; }
     };
 
   public:
 
+    // Iterator visits the keys in order. For sets of numbers, whose keys are stored in the Nodes, the iterator
+    // holds a copy of the key and operator* returns a reference to that copy. The reference is only valid until
+    // the iterator is advanced or destroyed, so auto & key = *S.find(k) dangles; copy the key instead.
     template <bool IsConst>
     struct Iterator
     {
       using value_type        = typename Self::value_type;
-      using TablePtr	      = typename std::conditional<IsConst, Table<key_type, mapped_type> const*, Table<key_type, mapped_type>*>::type;
+      using TablePtr	      = typename std::conditional<IsConst, Self const*, Self*>::type;
       using PayloadPtr        = typename std::conditional<IsConst, value_type const*, value_type *>::type;
-      using iterator_category = std::forward_iterator_tag;
+      using NodePtr           = typename std::conditional<IsConst, Node const*, Node *>::type;
+      using iterator_category = std::bidirectional_iterator_tag;
       using difference_type   = std::ptrdiff_t;
-      using reference         = typename std::conditional<IsConst, value_type const&, value_type&>::type;
-      using pointer           = typename std::conditional<IsConst, value_type const*, value_type*>::type;
+      using reference         = typename std::conditional<IsConst || inline_payload, value_type const&, value_type&>::type;
+      using pointer           = typename std::conditional<IsConst || inline_payload, value_type const*, value_type*>::type;
 
       // end iterator
       Iterator(TablePtr table) noexcept
@@ -262,304 +984,631 @@ namespace radix_cpp {
 	  depth_(0),
 	  ordinal_(0),
 	  offset_(0),
+	  prefix_hash_(0),
 	  hash0_(0),
 	  hash_(0),
-	  prefix_key_()
+	  level_(no_level),
+	  merges_(0),
+	  has_prefix_key_(true),
+	  prefix_key_(),
+	  value_()
       { }     
       
-      Iterator(TablePtr table, PayloadPtr ptr, size_t depth, internal_key_type prefix_key, size_t ordinal, size_t offset, size_t hash0, size_t hash) noexcept
+      Iterator(TablePtr table, PayloadPtr ptr, size_t depth, internal_key_type prefix_key, size_t ordinal, size_t offset, size_t prefix_hash, size_t hash) noexcept
+	: table_(table),
+	  ptr_(ptr),
+	  depth_(depth),
+	  ordinal_(ordinal),
+	  offset_(offset),
+	  prefix_hash_(prefix_hash),
+	  hash0_(calc_unordered_hash(depth, prefix_hash)),
+	  hash_(hash),
+	  level_(no_level),
+	  merges_(table->num_merges_),
+	  has_prefix_key_(true),
+	  prefix_key_(std::move(prefix_key)),
+	  value_(load_value(ptr))
+      { }
+
+      // final Node iterator without the prefix key, which is restored from the payload when needed
+      Iterator(TablePtr table, PayloadPtr ptr, size_t depth, size_t ordinal, size_t offset, size_t prefix_hash, size_t hash) noexcept
 	: table_(table),
 	  ptr_(ptr),
 	  depth_(depth),
 	  ordinal_(ordinal),
 	  offset_(offset),
-	  hash0_(hash0),
+	  prefix_hash_(prefix_hash),
+	  hash0_(calc_unordered_hash(depth, prefix_hash)),
 	  hash_(hash),
-	  prefix_key_(std::move(prefix_key))
+	  level_(no_level),
+	  merges_(table->num_merges_),
+	  has_prefix_key_(false),
+	  prefix_key_(),
+	  value_(load_value(ptr))
+      { }
+
+      // conversion from iterator to const_iterator
+      template <bool O, typename std::enable_if<IsConst && !O>::type* = nullptr>
+      Iterator(const Iterator<O> & other) noexcept
+	: table_(other.table_),
+	  ptr_(other.ptr_),
+	  depth_(other.depth_),
+	  ordinal_(other.ordinal_),
+	  offset_(other.offset_),
+	  prefix_hash_(other.prefix_hash_),
+	  hash0_(other.hash0_),
+	  hash_(other.hash_),
+	  level_(other.level_),
+	  merges_(other.merges_),
+	  has_prefix_key_(other.has_prefix_key_),
+	  prefix_key_(other.prefix_key_),
+	  value_(other.value_)
       { }
       
       reference operator*() const noexcept {
-	return *ptr_;
+	if constexpr (inline_payload) {
+	  return value_;
+	} else {
+	  return *ptr_;
+	}
       }
       
       pointer operator->() noexcept {
-	return ptr_;
+	if constexpr (inline_payload) {
+	  return &value_;
+	} else {
+	  return ptr_;
+	}
       }
       
       Iterator& operator++() noexcept {
 	if (!ptr_) {
 	  return *this; // already ended
 	}
+	restore_prefix_key();
 	
 	// go to the next direct Node
 	if (depth_ == 0) {
 	  // empty key
 	  depth_++;
-	  ordinal_ = offset_ = 0;
-	  hash0_ = calc_unordered_hash(depth_, prefix_key_);
+	  ordinal_ = 0;
+	  hash0_ = calc_unordered_hash(depth_, prefix_hash_);
+	  level_ = root_level;
 	} else {
 	  auto node = repair_and_get_node();
-	  if (node->get_value_count() > 1) {
+	  if (node->is_detached()) {
+	    // continue from the head of the compressed path, since the Nodes between them don't exist
+	    size_t child_ordinal;
+	    table_->find_ancestor(depth_, prefix_key_, prefix_hash_, ordinal_, child_ordinal);
+	    hash0_ = calc_unordered_hash(depth_, prefix_hash_);
+	    level_ = no_level;
+	    ordinal_++;
+	  } else if (node->get_children()) {
 	    depth_++;
-	    prefix_key_ = append(std::move(prefix_key_), ordinal_);
+	    prefix_key_ = append(std::move(prefix_key_), ordinal_, digits{});
+	    prefix_hash_ = extend_prefix_hash(prefix_hash_, ordinal_);
 	    ordinal_ = 0;
-	    hash0_ = calc_unordered_hash(depth_, prefix_key_);
+	    hash0_ = calc_unordered_hash(depth_, prefix_hash_);
+	    level_ = node->get_children();
 	  } else {
 	    ordinal_++;
 	  }
-	  offset_ = 0;
 	}
 
-	// iterate until a final Node is found
-	hash_ = calc_final_hash(hash0_, ordinal_);
-	auto node = table_->read_node(hash_);
-	auto nodes_start = table_->get_nodes_start(), nodes_end = table_->get_nodes_end();
+	seek();
+	return *this;
+      }
+      
+      Iterator operator++(int) noexcept {
+	Iterator<IsConst> tmp = *this;
+	++(*this);
+	return tmp;
+      }
 
-	while ( 1 ) {
-	  if (ordinal_ == bucket_count) {
-	    // we have run through the whole range => go down the tree
-	    if (depth_ <= 1) {
-	      clear(); // become an end iterator
-	      return *this;
-	    } else {
-	      auto [ parent_ordinal, parent_prefix_key ] = deconstruct(std::move(prefix_key_));
-	      depth_--;
-	      prefix_key_ = std::move(parent_prefix_key);
-	      ordinal_ = parent_ordinal + 1;
-	      offset_ = 0;
-	      hash0_ = calc_unordered_hash(depth_, prefix_key_);
-	      hash_ = calc_final_hash(hash0_, ordinal_);
-	      node = table_->read_node(hash_);
-	    }
-	  } else if (!node->is_assigned()) {
-	    if (node->is_tombstone()) {
-	      // collision
-	      if (++node == nodes_end) node = nodes_start;
-	      offset_++;
-	    } else {
-	      // Node is not assigned
-	      ordinal_++;
-	      offset_ = 0;
-	      hash_ = calc_final_hash(hash0_, ordinal_);
-	      node = table_->read_node(hash_);
-	    }
-	  } else if (!node->equals(depth_, prefix_key_, ordinal_)) {
-	    // collision
-	    if (++node == nodes_end) node = nodes_start;
-	    offset_++;
-	  } else if (node->get_payload()) {
-	    // a final Node was found
-	    set_ptr(node->get_payload());
+      // operator-- mirrors operator++. The end iterator moves to the last key, and the first key to the end.
+      Iterator& operator--() noexcept {
+	if (!ptr_) {
+	  if (!table_->table_size_) return *this;
+	  depth_ = 1;
+	  ordinal_ = bucket_count;
+	  hash0_ = calc_unordered_hash(depth_, prefix_hash_);
+	  level_ = root_level;
+	} else {
+	  restore_prefix_key();
+	  if (depth_ == 0) {
+	    clear(); // the empty key is the first key
 	    return *this;
-	  } else {
-	    // non-final node => go up the tree
-	    depth_++;
-	    prefix_key_ = append(std::move(prefix_key_), ordinal_);
-	    ordinal_ = offset_ = 0;
-	    offset_ = 0;
-	    hash0_ = calc_unordered_hash(depth_, prefix_key_);
-	    hash_ = calc_final_hash(hash0_, ordinal_);
-	    node = table_->read_node(hash_);
+	  }
+	  auto node = repair_and_get_node();
+	  if (node->is_detached()) {
+	    // continue from the head of the compressed path, whose siblings precede the key
+	    size_t child_ordinal;
+	    table_->find_ancestor(depth_, prefix_key_, prefix_hash_, ordinal_, child_ordinal);
+	    hash0_ = calc_unordered_hash(depth_, prefix_hash_);
+	    level_ = no_level;
 	  }
 	}
+
+	seek_back();
+	return *this;
       }
-      
-      Iterator operator++(int) noexcept {
+
+      Iterator operator--(int) noexcept {
 	Iterator<IsConst> tmp = *this;
-	++(*this);
+	--(*this);
 	return tmp;
       }
       
+      // the iterators of inline payloads are compared by the value, since the Nodes move when the table is resized
       template <bool O>
       bool operator== (const Iterator<O>& o) const noexcept {
-	return ptr_ == o.ptr_;
+	if constexpr (inline_payload) {
+	  return ptr_ && o.ptr_ ? same_value(value_, o.value_) : ptr_ == o.ptr_;
+	} else {
+	  return ptr_ == o.ptr_;
+	}
       }
       
       template <bool O>
       bool operator!= (const Iterator<O>& o) const noexcept {
-	return ptr_ != o.ptr_;
+	return !(*this == o);
       }
       
       void fast_forward() noexcept {
 	if (depth_ == 0) {
-	  hash0_ = calc_unordered_hash(depth_, prefix_key_);
+	  hash0_ = calc_unordered_hash(depth_, prefix_hash_);
 	  hash_ = calc_final_hash(hash0_, ordinal_);
+	  offset_ = 0;
 
 	  // first look for 0-length node (depth = ordinal = 0)
-	  while (1) {
-	    auto node = table_->read_node(hash_, offset_);
-	    if (node->is_assigned()) {
-	      if (!node->equals(depth_, prefix_key_, 0)) {
-		// collision
-		offset_++;
-		continue;
-	      } else if (node->get_payload()) {
-		set_ptr(node->get_payload());
-		return;
-	      }
-	    } else if (node->is_tombstone()) {
-	      // collision
-	      offset_++;
-	    }
-	    break;
+	  auto node = table_->find_node(hash_, depth_, prefix_key_, 0);
+	  if (node && node->get_payload()) {
+	    offset_ = table_->get_offset(node, hash_);
+	    set_ptr(node->get_payload());
+	    return;
 	  }
 	
 	  depth_ = 1;
-	  offset_ = 0;
-	  hash0_ = calc_unordered_hash(depth_, prefix_key_);
-	  hash_ = calc_final_hash(hash0_, ordinal_);
-	}
-	
-	while ( 1 ) {
-	  if (ordinal_ == bucket_count) {
-	    if (depth_ <= 1) {
-	      clear(); // become an end iterator
-	      break;
-	    } else {
-	      depth_--;
-	      auto [ parent_ordinal, parent_prefix_key ] = deconstruct(std::move(prefix_key_));
-	      prefix_key_ = std::move(parent_prefix_key);
-	      ordinal_ = parent_ordinal + 1;
-	      offset_ = 0;
-	      ptr_ = nullptr;
-	      hash0_ = calc_unordered_hash(depth_, prefix_key_);
-	      hash_ = calc_final_hash(hash0_, ordinal_);
-	    }
-	  } else {
-	    auto node = table_->read_node(hash_, offset_);
-	    if (!node->is_assigned()) {
-	      if (node->is_tombstone()) {
-		// collision
-		offset_++;
-	      } else {
-		// unassigned
-		ordinal_++;
-		offset_ = 0;
-		hash_ = calc_final_hash(hash0_, ordinal_);
-	      }
-	    } else if (!node->equals(depth_, prefix_key_, ordinal_)) {
-	      // collision
-	      offset_++;
-	    } else if (node->get_payload()) {
-	      set_ptr(node->get_payload());
-	      return;
-	    } else {
-	      depth_++;
-	      prefix_key_ = append(std::move(prefix_key_), ordinal_);
-	      ordinal_ = 0;
-	      hash0_ = calc_unordered_hash(depth_, prefix_key_);
-	      hash_ = calc_final_hash(hash0_, ordinal_);
-	    }
-	  }
+	  hash0_ = calc_unordered_hash(depth_, prefix_hash_);
+	  level_ = root_level;
 	}
+
+	ptr_ = nullptr;
+	seek();
       }
 
       void down() {
+	restore_prefix_key();
 	if (depth_ <= 1) {
 	  clear(); // become an end iterator
 	} else {
 	  depth_--;
-	  auto [ parent_ordinal, parent_prefix_key ] = deconstruct(std::move(prefix_key_));
+	  auto [ parent_ordinal, parent_prefix_key ] = deconstruct(std::move(prefix_key_), digits{});
 	  prefix_key_ = std::move(parent_prefix_key);
+	  prefix_hash_ = truncate_prefix_hash(prefix_hash_, parent_ordinal);
 	  ordinal_ = parent_ordinal;
 	  offset_ = 0;
 	  ptr_ = nullptr;
-	  hash0_ = calc_unordered_hash(depth_, prefix_key_);
+	  level_ = no_level;
+	  hash0_ = calc_unordered_hash(depth_, prefix_hash_);
 	  hash_ = calc_final_hash(hash0_, ordinal_);
-	  while ( 1 ) {
-	    auto node = table_->read_node(hash_, offset_);
-	    if (!node->is_assigned()) {
-	      if (node->is_tombstone()) {
-		offset_++;
-	      } else {
+	  auto node = table_->find_node(hash_, depth_, prefix_key_, ordinal_);
+	  if (!node) {
 #ifdef DEBUG
-		std::cerr << "down() failed\n";
+	    std::cerr << "down() failed\n";
 #endif
-		abort();
-	      }
-	    } else if (node->equals(depth_, prefix_key_, ordinal_)) {
-	      break;
-	    } else {
-	      offset_++;
-	    }
+	    abort();
 	  }
+	  offset_ = table_->get_offset(node, hash_);
 	}
       }
 
-      Node * repair_and_get_node() {
-	auto node0 = table_->read_node(hash_, offset_);
-	if (ptr_ == node0->get_payload()) return node0;
-	auto node = table_->read_node(hash_);
-	offset_ = 0;
-	while ( 1 ) {
-	  auto node = table_->read_node(hash_, offset_);
-	  if (!node->is_assigned()) {
-	    if (!node->is_tombstone()) {
+      // returns the current Node. The cached offset is updated if the Node has been moved by resizing.
+      // The Nodes of the first digit never move. If the value has moved to another Node, because the
+      // compressed path holding it has been split or merged, the iterator is moved to its final Node.
+      NodePtr repair_and_get_node() {
+	check_level();
+	NodePtr node0 = direct_top && depth_ == 1 ? table_->top_ + ordinal_ : table_->read_node(hash_, offset_);
+	if (holds_value(node0, get_value_ptr()) && node0->get_depth_lsb() == (depth_ & 0xff) && node0->get_ordinal() == ordinal_) return node0;
+	NodePtr node = direct_top && depth_ == 1 ? nullptr : table_->find_payload_node(hash_, depth_, ordinal_, get_value_ptr());
+	if (!node) node = reseat();
+	if (!node) {
 #ifdef DEBUG
-	      std::cerr << "repair failed\n";
+	  std::cerr << "repair failed\n";
 #endif
-	      abort();
-	    }
-	  } else if (ptr_ == node->get_payload()) {
-	    return node;
-	  }
-	  offset_++;
+	  abort();
 	}
+	offset_ = table_->get_offset(node, hash_);
 	return node;
       }
 
       size_t get_depth() const noexcept { return depth_; }
-      const internal_key_type & get_prefix_key() const noexcept { return prefix_key_; }
+      const internal_key_type & get_prefix_key() noexcept {
+	restore_prefix_key();
+	return prefix_key_;
+      }
       size_t get_ordinal() const noexcept { return ordinal_; }
       size_t get_offset() const noexcept { return offset_; }
       size_t get_hash() const noexcept { return hash_; }
+
+      // returns the Level containing the current Node, and looks it up if needed
+      uint32_t get_level() noexcept {
+	check_level();
+	if (level_ == no_level) {
+	  restore_prefix_key();
+	  level_ = table_->find_level(depth_, prefix_key_, prefix_hash_);
+	}
+	return level_;
+      }
+      void set_level(uint32_t level) noexcept { level_ = level; }
       
-      void set_ptr(PayloadPtr ptr) { ptr_ = ptr; }
+      void set_ptr(PayloadPtr ptr) {
+	ptr_ = ptr;
+	value_ = load_value(ptr);
+      }
+
+      // returns the value, or null for an end iterator
+      const value_type * get_value_ptr() const noexcept {
+	if constexpr (inline_payload) {
+	  return ptr_ ? &value_ : nullptr;
+	} else {
+	  return ptr_;
+	}
+      }
       
+      void restore_prefix_key() {
+	if (!has_prefix_key_) {
+	  prefix_key_ = deconstruct(getFirstConst(**this), digits{}).second;
+	  has_prefix_key_ = true;
+	}
+      }
+
     private:
+      template <bool> friend struct Iterator;
+
+      // forgets the cached Level if paths have been merged since, because merging frees Levels that still had keys
+      void check_level() noexcept {
+	if (merges_ != table_->num_merges_) {
+	  level_ = no_level;
+	  merges_ = table_->num_merges_;
+	}
+      }
+
+      // moves the iterator to the final Node of the current value, and returns it
+      NodePtr reseat() {
+	const auto & key = getFirstConst(**this);
+	auto [ ordinal, prefix_key ] = deconstruct(key, digits{});
+	depth_ = keysize(key, digits{});
+	ordinal_ = ordinal;
+	prefix_hash_ = calc_prefix_hash(depth_, prefix_key);
+	hash0_ = calc_unordered_hash(depth_, prefix_hash_);
+	hash_ = calc_final_hash(hash0_, ordinal_);
+	prefix_key_ = std::move(prefix_key);
+	has_prefix_key_ = true;
+	level_ = no_level;
+	return table_->find_node(hash_, depth_, prefix_key_, ordinal_);
+      }
+
+      // seek advances from the current ordinal until a final Node is found, using
+      // the occupancy bitmaps to skip over the ordinals that are not present
+      void seek() noexcept {
+	while ( 1 ) {
+	  if (level_ == no_level) {
+	    level_ = table_->find_level(depth_, prefix_key_, prefix_hash_);
+	  }
+	  if (level_ != no_level) {
+	    ordinal_ = table_->levels_[level_].next(ordinal_);
+	  } else {
+	    ordinal_ = bucket_count; // the level has no nodes
+	  }
+	  
+	  if (ordinal_ == bucket_count) {
+	    // we have run through the whole range => go down the tree
+	    if (depth_ <= 1) {
+	      clear(); // become an end iterator
+	      return;
+	    }
+	    auto [ parent_ordinal, parent_prefix_key ] = deconstruct(std::move(prefix_key_), digits{});
+	    depth_--;
+	    prefix_key_ = std::move(parent_prefix_key);
+	    prefix_hash_ = truncate_prefix_hash(prefix_hash_, parent_ordinal);
+	    ordinal_ = parent_ordinal + 1;
+	    hash0_ = calc_unordered_hash(depth_, prefix_hash_);
+	    if (level_ != no_level) level_ = table_->levels_[level_].get_parent();
+	    continue;
+	  }
+	    
+	  hash_ = calc_final_hash(hash0_, ordinal_);
+	  auto node = table_->find_node(hash_, depth_, prefix_key_, ordinal_, level_);
+
+	  if (!node) {
+#ifdef DEBUG
+	    std::cerr << "occupancy bitmap is out of sync\n";
+#endif
+	    ordinal_++;
+	  } else if (node->get_payload()) {
+	    // a final Node was found
+	    offset_ = table_->get_offset(node, hash_);
+	    set_ptr(node->get_payload());
+	    return;
+	  } else {
+	    // non-final node => go up the tree
+	    depth_++;
+	    prefix_key_ = append(std::move(prefix_key_), ordinal_, digits{});
+	    prefix_hash_ = extend_prefix_hash(prefix_hash_, ordinal_);
+	    ordinal_ = 0;
+	    hash0_ = calc_unordered_hash(depth_, prefix_hash_);
+	    level_ = node->get_children();
+	  }
+	}
+      }
+
+      // seek_back moves to the last key before the current Node, which is the last key below the nearest smaller
+      // sibling, or else the key of the parent, since a Node precedes its children. The empty key is the first key.
+      void seek_back() noexcept {
+	while ( 1 ) {
+	  if (level_ == no_level) {
+	    level_ = table_->find_level(depth_, prefix_key_, prefix_hash_);
+	  }
+	  auto ordinal = level_ != no_level && ordinal_ ? table_->levels_[level_].prev(ordinal_ - 1) : bucket_count;
+
+	  if (ordinal != bucket_count) {
+	    ordinal_ = ordinal;
+	    hash_ = calc_final_hash(hash0_, ordinal_);
+	    auto node = table_->find_node(hash_, depth_, prefix_key_, ordinal_, level_);
+	    if (!node) {
+#ifdef DEBUG
+	      std::cerr << "occupancy bitmap is out of sync\n";
+#endif
+	    } else if (node->get_children()) {
+	      // the last key below the sibling => go up the tree
+	      depth_++;
+	      prefix_key_ = append(std::move(prefix_key_), ordinal_, digits{});
+	      prefix_hash_ = extend_prefix_hash(prefix_hash_, ordinal_);
+	      ordinal_ = bucket_count;
+	      hash0_ = calc_unordered_hash(depth_, prefix_hash_);
+	      level_ = node->get_children();
+	    } else {
+	      // a Node without children is final, or the head of a compressed path
+	      offset_ = table_->get_offset(node, hash_);
+	      set_ptr(node->get_payload());
+	      return;
+	    }
+	    continue;
+	  }
+
+	  // we have run through the smaller siblings => go down the tree
+	  if (depth_ <= 1) {
+	    depth_ = 0;
+	    prefix_key_ = internal_key_type{};
+	    prefix_hash_ = 0;
+	    ordinal_ = 0;
+	    hash0_ = calc_unordered_hash(depth_, prefix_hash_);
+	    hash_ = calc_final_hash(hash0_, ordinal_);
+	    auto node = table_->find_node(hash_, depth_, prefix_key_, 0);
+	    if (node && node->get_payload()) {
+	      offset_ = table_->get_offset(node, hash_);
+	      level_ = no_level;
+	      set_ptr(node->get_payload());
+	    } else {
+	      clear(); // become an end iterator
+	    }
+	    return;
+	  }
+	  auto [ parent_ordinal, parent_prefix_key ] = deconstruct(std::move(prefix_key_), digits{});
+	  depth_--;
+	  prefix_key_ = std::move(parent_prefix_key);
+	  prefix_hash_ = truncate_prefix_hash(prefix_hash_, parent_ordinal);
+	  ordinal_ = parent_ordinal;
+	  hash0_ = calc_unordered_hash(depth_, prefix_hash_);
+	  hash_ = calc_final_hash(hash0_, ordinal_);
+	  if (level_ != no_level) level_ = table_->levels_[level_].get_parent();
+	  auto node = table_->find_node(hash_, depth_, prefix_key_, ordinal_, level_);
+	  if (node && node->get_payload()) {
+	    // the parent has a key of its own
+	    offset_ = table_->get_offset(node, hash_);
+	    set_ptr(node->get_payload());
+	    return;
+	  }
+	}
+      }
+
       void clear() {
 	ptr_ = nullptr;
 	depth_ = 0;
 	prefix_key_ = internal_key_type{};
 	ordinal_ = 0;
 	offset_ = 0;
+	prefix_hash_ = 0;
 	hash0_ = 0;
 	hash_ = 0;
+	level_ = no_level;
+	has_prefix_key_ = true;
       }
       
+      static InlineValue load_value(PayloadPtr ptr) noexcept {
+	if constexpr (inline_payload) {
+	  return ptr ? *ptr : InlineValue();
+	} else {
+	  return InlineValue();
+	}
+      }
+
       TablePtr table_;
-      PayloadPtr ptr_;
+      PayloadPtr ptr_; // the payload, or for inline payloads a non-null pointer to the Node that may be out of date
 
       // * cached values
       // they are all obtainable from ptr_, but it's faster to cache them
       // only temporarily can an iterator might point to a non-final Node (a node that has no ptr_)
-      size_t depth_, ordinal_, offset_, hash0_, hash_;
+      size_t depth_, ordinal_, offset_, prefix_hash_, hash0_, hash_;
+      uint32_t level_; // the Level of the current depth and prefix, or no_level if it hasn't been looked up
+      size_t merges_; // the number of merges in the table when level_ was known to be valid
+      bool has_prefix_key_; // false if the prefix key must be restored from the payload
       internal_key_type prefix_key_;
+      InlineValue value_; // the copy of an inline payload
     };
     
     using iterator = Iterator<false>;
     using const_iterator = Iterator<true>;
 
-    Table() noexcept { }
+    // ReverseIterator is positioned at its current key, unlike std::reverse_iterator, since the keys of inline
+    // payloads are copies held by the iterator. The end of a reverse iteration is the end iterator.
+    template <bool IsConst>
+    struct ReverseIterator
+    {
+      using value_type        = typename Self::value_type;
+      using iterator_category = std::bidirectional_iterator_tag;
+      using difference_type   = std::ptrdiff_t;
+      using reference         = typename Iterator<IsConst>::reference;
+      using pointer           = typename Iterator<IsConst>::pointer;
+
+      explicit ReverseIterator(Iterator<IsConst> it) noexcept : it_(std::move(it)) { }
+
+      reference operator*() const noexcept { return *it_; }
+      pointer operator->() noexcept { return it_.operator->(); }
+
+      ReverseIterator& operator++() noexcept { --it_; return *this; }
+      ReverseIterator operator++(int) noexcept { auto tmp = *this; --it_; return tmp; }
+      ReverseIterator& operator--() noexcept { ++it_; return *this; }
+      ReverseIterator operator--(int) noexcept { auto tmp = *this; ++it_; return tmp; }
+
+      bool operator== (const ReverseIterator & o) const noexcept { return it_ == o.it_; }
+      bool operator!= (const ReverseIterator & o) const noexcept { return it_ != o.it_; }
+
+      // returns the iterator of the key after the current one, as std::reverse_iterator does
+      Iterator<IsConst> base() const noexcept { auto it = it_; return ++it; }
+
+    private:
+      Iterator<IsConst> it_;
+    };
+
+    using reverse_iterator = ReverseIterator<false>;
+    using const_reverse_iterator = ReverseIterator<true>;
+
+    // UnorderedIterator visits the keys in the order of the node arrays: the Nodes of the first digit, the node
+    // array, and the old node array during an incremental resize. The heads of compressed paths are skipped,
+    // since their final Nodes hold the same payloads. It is invalidated by any insert or erase.
+    template <bool IsConst>
+    struct UnorderedIterator
+    {
+      using value_type        = typename Self::value_type;
+      using TablePtr	      = typename std::conditional<IsConst, Self const*, Self*>::type;
+      using NodePtr           = typename std::conditional<IsConst, Node const*, Node *>::type;
+      using iterator_category = std::forward_iterator_tag;
+      using difference_type   = std::ptrdiff_t;
+      using reference         = typename Iterator<IsConst>::reference;
+      using pointer           = typename Iterator<IsConst>::pointer;
+
+      // end iterator
+      UnorderedIterator() noexcept : table_(nullptr), node_(nullptr), end_(nullptr), array_(num_arrays) { }
+
+      explicit UnorderedIterator(TablePtr table) noexcept : table_(table), node_(nullptr), end_(nullptr), array_(0) {
+	seek();
+      }
+
+      reference operator*() const noexcept { return *node_->get_payload(); }
+      pointer operator->() const noexcept { return node_->get_payload(); }
+
+      UnorderedIterator& operator++() noexcept {
+	node_++;
+	seek();
+	return *this;
+      }
+
+      UnorderedIterator operator++(int) noexcept {
+	auto tmp = *this;
+	++(*this);
+	return tmp;
+      }
+
+      bool operator== (const UnorderedIterator & o) const noexcept { return node_ == o.node_; }
+      bool operator!= (const UnorderedIterator & o) const noexcept { return node_ != o.node_; }
+
+    private:
+      static constexpr size_t num_arrays = 3;
+
+      // seek advances to the next Node with a key of its own, moving on to the next array at the end of one
+      void seek() noexcept {
+	while ( 1 ) {
+	  for (; node_ != end_; node_++) {
+	    if (node_->is_assigned() && node_->get_payload() && !node_->is_head()) return;
+	  }
+	  if (array_ == num_arrays) {
+	    node_ = end_ = nullptr;
+	    return;
+	  }
+	  switch (array_++) {
+	  case 0: node_ = table_->top_; end_ = node_ ? node_ + bucket_count : nullptr; break;
+	  case 1: node_ = table_->nodes_; end_ = node_ ? node_ + table_->table_size_ : nullptr; break;
+	  case 2: node_ = table_->old_nodes_; end_ = node_ ? node_ + table_->old_mask_ + 1 : nullptr; break;
+	  }
+	}
+      }
+
+      TablePtr table_;
+      NodePtr node_, end_; // the current Node, and the end of its array
+      size_t array_; // the index of the next array
+    };
+
+    using unordered_iterator = UnorderedIterator<false>;
+    using const_unordered_iterator = UnorderedIterator<true>;
+
+    // BasicRange is the pair of iterators returned by range(), usable in a range-based for loop
+    template <bool IsConst>
+    struct BasicRange {
+      Iterator<IsConst> first, last;
+      Iterator<IsConst> begin() const noexcept { return first; }
+      Iterator<IsConst> end() const noexcept { return last; }
+      bool empty() const noexcept { return first == last; }
+    };
+
+    using Range = BasicRange<false>;
+    using ConstRange = BasicRange<true>;
+
+    Table() noexcept : Table(Allocator()) { }
+
+    explicit Table(const Allocator & alloc) noexcept
+      : node_alloc_(alloc), arena_(alloc), levels_(alloc), free_levels_(alloc) { }
+
+    template<class InputIt>
+    Table(InputIt first, InputIt last, const Allocator & alloc = Allocator()) : Table(alloc) {
+      assign(first, last);
+    }
+
     Table(Table && other) noexcept
       : num_entries_(std::exchange(other.num_entries_, 0)),
 	num_final_entries_(std::exchange(other.num_final_entries_, 0)),
 	num_inserts_(std::exchange(other.num_inserts_, 0)),
 	num_insert_collisions_(std::exchange(other.num_insert_collisions_, 0)),
+	num_resizes_(std::exchange(other.num_resizes_, 0)),
+	num_merges_(std::exchange(other.num_merges_, 0)),
+	num_tombstones_(std::exchange(other.num_tombstones_, 0)),
 	table_size_(std::exchange(other.table_size_, 0)),
 	table_mask_(std::exchange(other.table_mask_, 0)),
+	inserts_remaining_(std::exchange(other.inserts_remaining_, 0)),
+	node_alloc_(other.node_alloc_),
 	nodes_(std::exchange(other.nodes_, nullptr)),
-    	arena_(std::move(other.arena_)) { }
+	top_(std::exchange(other.top_, nullptr)),
+    	arena_(std::move(other.arena_)),
+	levels_(std::move(other.levels_)),
+	free_levels_(std::move(other.free_levels_)),
+	append_hint_(std::exchange(other.append_hint_, nullptr)),
+	append_value_(other.append_value_),
+	append_level_(std::exchange(other.append_level_, no_level)),
+	incremental_resize_(other.incremental_resize_),
+	old_nodes_(std::exchange(other.old_nodes_, nullptr)),
+	old_mask_(std::exchange(other.old_mask_, 0)),
+	migrate_pos_(std::exchange(other.migrate_pos_, 0)),
+	mapping_(std::exchange(other.mapping_, nullptr)),
+	mapping_size_(std::exchange(other.mapping_size_, 0)) { }
 
+    // the contents are destroyed, and the contents and the allocator of the other table are moved in. The memory
+    // is always released by the allocator that allocated it, even if the allocators of the tables differ.
     Table & operator=(Table && other) noexcept {
-      std::swap(num_entries_, other.num_entries);
-      std::swap(num_final_entries_, other.num_final_entries_);
-      std::swap(num_inserts_, other.num_inserts_);
-      std::swap(num_insert_collisions_, other.num_insert_collisons_);
-      std::swap(table_size_, other.table_size_);
-      std::swap(table_mask_, other.table_mask_);
-      std::swap(nodes_, other.nodes_);
-      std::swap(arena_, other.arena_);
+      if (this != &other) {
+	this->~Table();
+	new (static_cast<void*>(this)) Table(std::move(other));
+      }
       return *this;
     }
     
@@ -570,167 +1619,360 @@ namespace radix_cpp {
       clear();
     }
 
+    // clear removes the contents, and releases the mapping of a loaded table
     void clear() noexcept {
-      for (size_t i = 0; i < table_size_; i++) {
-	auto & node = nodes_[i];
-	if (node.is_assigned()) {
-	  node.get_prefix_key().~internal_key_type();
-	  if (node.get_payload()) {
-	    node.get_payload()->~value_type();
-	  }
-	}
+      if (mapping_) unmap_file();
+      destroy_nodes(nodes_, table_size_);
+      if (top_) {
+	destroy_nodes(top_, bucket_count);
+	top_ = nullptr;
+      }
+      if (old_nodes_) {
+	destroy_nodes(old_nodes_, old_mask_ + 1);
+	old_nodes_ = nullptr;
       }
-      std::free(nodes_);
-      num_entries_ = num_final_entries_ = num_inserts_ = num_insert_collisions_ = table_size_ = table_mask_ = 0;
+      num_entries_ = num_final_entries_ = num_inserts_ = num_insert_collisions_ = num_resizes_ = num_tombstones_ = table_size_ = table_mask_ = inserts_remaining_ = 0;
       nodes_ = nullptr;
       arena_.clear();
+      levels_.clear();
+      free_levels_.clear();
+      append_hint_ = nullptr;
     }
     
     iterator find(const key_type & key) noexcept {
-      if (!table_size_) return end();
-      auto [ ordinal, prefix_key ] = deconstruct(key);
-      auto depth = keysize(key);
-      auto hash0 = calc_unordered_hash(depth, prefix_key);
-      auto hash = calc_final_hash(hash0, ordinal);  
-      auto node_initial = read_node(hash);
-      auto nodes_start = get_nodes_start(), nodes_end = get_nodes_end();
-
-      auto node = node_initial;
-      while ( 1 ) {
-	if (!node->is_assigned()) {
-	  if (node->is_tombstone()) {
-	    // collision
-	    if (++node == nodes_end) node = nodes_start;
-	  } else {
-	    break; // not found
-	  }
-	} else if (!node->equals(depth, prefix_key, ordinal)) {
-	  // collision
-	  if (++node == nodes_end) node = nodes_start;
-	} else if (node->get_payload()) {
-	  return iterator(this, node->get_payload(), depth, prefix_key, ordinal, static_cast<size_t>(node - node_initial), hash0, hash);
-	} else {
-	  break; // not final / wrong key
-	}
-      }
-      return end();
+      return find_impl<iterator>(this, make_lookup_key(key));
     }
 
     const_iterator find(const key_type & key) const noexcept {
-      if (!table_size_) return cend();
-      auto [ ordinal, prefix_key ] = deconstruct(key);
-      auto depth = keysize(prefix_key);
-      auto hash0 = calc_unordered_hash(depth, prefix_key);
-      auto hash = calc_final_hash(hash0, ordinal);  
-      auto node_initial = read_node(hash);
-      auto nodes_start = get_nodes_start(), nodes_end = get_nodes_end();
-
-      auto node = node_initial;
-      while ( 1 ) {
-	if (!node->is_assigned()) {
-	  if (node->is_tombstone()) {
-	    // collision
-	    if (++node == nodes_end) node = nodes_start;
-	  } else {
-	    break; // not found
-	  }
-	} else if (!node->equals(depth, prefix_key, ordinal)) {
-	  // collision
-	  if (++node == nodes_end) node = nodes_start;
-	} else if (node->get_payload()) {
-	  return const_iterator(this, node->get_payload(), depth, prefix_key, ordinal, static_cast<size_t>(node - node_initial), hash0, hash);
-	} else {
-	  break; // not final / wrong key
-	}
-      }
-      return cend();
+      return find_impl<const_iterator>(this, make_lookup_key(key));
     }
 
-    iterator upper_bound(const key_type& key) {
-      if (!table_size_) return end();
-      auto [ ordinal, prefix_key ] = deconstruct(key);
-      auto depth = keysize(key);
-      auto hash0 = calc_unordered_hash(depth, prefix_key);
-      auto hash = calc_final_hash(hash0, ordinal);  
-      auto node_initial = read_node(hash);
-      auto nodes_start = get_nodes_start(), nodes_end = get_nodes_end();
-      
-      auto node = node_initial;
-      while ( 1 ) {
-	if (node->is_tombstone() || (node->is_assigned() && !node->equals(depth, prefix_key, ordinal))) {
-	  // collision
-	  if (++node == nodes_end) node = nodes_start;
-	} else {
-	  iterator it(this, node->get_payload(), depth, prefix_key, ordinal, static_cast<size_t>(node - node_initial), hash0, hash);
-	  if (node->is_assigned() && node->get_payload()) {
-	    it++;
-	  } else {
-	    it.fast_forward();
-	  }
-	  return it;
-	}
-      }
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    iterator find(const K & key) noexcept {
+      return find_impl<iterator>(this, std::string_view(key));
     }
 
-    size_t count(const key_type & key) const noexcept {
-      return find(key) == cend() ? 0 : 1;
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    const_iterator find(const K & key) const noexcept {
+      return find_impl<const_iterator>(this, std::string_view(key));
     }
-    
-    template <typename Q = mapped_type>
-    typename std::enable_if<!std::is_void<Q>::value, std::pair<iterator,bool>>::type insert_or_assign(const Key& k, Q && obj) {
-      auto [ node, it ] = create_nodes_for_key(k);
-      bool is_new = true;	
-      if (!node->get_payload()) {
-	node->set_payload(arena_.alloc());
-	it.set_ptr(node->get_payload());
-	new (static_cast<void*>(node->get_payload())) value_type(k, std::move(obj));
-	num_final_entries_++;
-      } else {
-	*(node->get_payload()) = value_type(k, std::move(obj));
-	is_new = false;
-      }
-      return std::make_pair(it, is_new);
+
+    iterator lower_bound(const key_type & key) {
+      return bound_impl<iterator>(this, make_lookup_key(key), false);
     }
 
-    template <typename... Args>
-    std::pair<iterator,bool> emplace(Args&&... args) {
-      value_type vt{std::forward<Args>(args)...};
-      auto [ node, it ] = create_nodes_for_key(getFirstConst(vt));
-      bool is_new = true;
-      if (!node->get_payload()) {
-	node->set_payload(arena_.alloc());
-	it.set_ptr(node->get_payload());
-	new (static_cast<void*>(node->get_payload())) value_type(std::move(vt));
-	num_final_entries_++;
-      } else {
-	is_new = false;
-      }
-      return std::make_pair(it, is_new);
+    const_iterator lower_bound(const key_type & key) const {
+      return bound_impl<const_iterator>(this, make_lookup_key(key), false);
     }
 
-    std::pair<iterator, bool> insert(const value_type& keyval) {
-      return emplace(keyval);
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    iterator lower_bound(const K & key) {
+      return bound_impl<iterator>(this, std::string_view(key), false);
     }
 
-    std::pair<iterator, bool> insert(value_type&& keyval) {
-      return emplace(std::move(keyval));
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    const_iterator lower_bound(const K & key) const {
+      return bound_impl<const_iterator>(this, std::string_view(key), false);
     }
 
-    iterator insert(const_iterator hint, const value_type& keyval) {
-      (void)hint;
-      return emplace(keyval).first;
+    iterator upper_bound(const key_type & key) {
+      return bound_impl<iterator>(this, make_lookup_key(key), true);
     }
 
-    template<class InputIt>
-    void insert(InputIt first, InputIt last) {
-      while (first != last) {
-	insert(*first);
+    const_iterator upper_bound(const key_type & key) const {
+      return bound_impl<const_iterator>(this, make_lookup_key(key), true);
+    }
+
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    iterator upper_bound(const K & key) {
+      return bound_impl<iterator>(this, std::string_view(key), true);
+    }
+
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    const_iterator upper_bound(const K & key) const {
+      return bound_impl<const_iterator>(this, std::string_view(key), true);
+    }
+
+    std::pair<iterator, iterator> equal_range(const key_type & key) {
+      return equal_range_impl<iterator>(this, make_lookup_key(key));
+    }
+
+    std::pair<const_iterator, const_iterator> equal_range(const key_type & key) const {
+      return equal_range_impl<const_iterator>(this, make_lookup_key(key));
+    }
+
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    std::pair<iterator, iterator> equal_range(const K & key) {
+      return equal_range_impl<iterator>(this, std::string_view(key));
+    }
+
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    std::pair<const_iterator, const_iterator> equal_range(const K & key) const {
+      return equal_range_impl<const_iterator>(this, std::string_view(key));
+    }
+
+    // range returns the keys in [first, last). The end is the lower bound of last, so that the loop ends by
+    // reaching its Node, and the keys are not compared with last.
+    Range range(const key_type & first, const key_type & last) {
+      return range_impl<iterator>(this, make_lookup_key(first), make_lookup_key(last));
+    }
+
+    ConstRange range(const key_type & first, const key_type & last) const {
+      return range_impl<const_iterator>(this, make_lookup_key(first), make_lookup_key(last));
+    }
+
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    Range range(const K & first, const K & last) {
+      return range_impl<iterator>(this, std::string_view(first), std::string_view(last));
+    }
+
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    ConstRange range(const K & first, const K & last) const {
+      return range_impl<const_iterator>(this, std::string_view(first), std::string_view(last));
+    }
+
+    size_t count(const key_type & key) const noexcept {
+      return find(key) == cend() ? 0 : 1;
+    }
+
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    size_t count(const K & key) const noexcept {
+      return find(key) == cend() ? 0 : 1;
+    }
+
+    // rank returns the number of keys less than the key. The value counts of the Nodes beside the path of the
+    // key are summed, so that a query takes at most a Level of probes per digit, instead of a walk over the keys.
+    size_t rank(const key_type & key) const {
+      return rank_impl(make_lookup_key(key));
+    }
+
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    size_t rank(const K & key) const {
+      return rank_impl(std::string_view(key));
+    }
+
+    // nth returns the key at position k in order, or end() if k >= size()
+    iterator nth(size_t k) {
+      auto payload = find_nth(k);
+      return payload ? find(getFirstConst(*payload)) : end();
+    }
+
+    const_iterator nth(size_t k) const {
+      auto payload = find_nth(k);
+      return payload ? find(getFirstConst(*payload)) : cend();
+    }
+
+    // count_range returns the number of keys in [first, last)
+    size_t count_range(const key_type & first, const key_type & last) const {
+      auto a = rank(first), b = rank(last);
+      return b > a ? b - a : 0;
+    }
+
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    size_t count_range(const K & first, const K & last) const {
+      auto a = rank(first), b = rank(last);
+      return b > a ? b - a : 0;
+    }
+
+    // prefix_range returns the keys of a string table that start with the prefix. They are the subtree of the
+    // Node of the prefix, which is found with a single probe, and the end is the next sibling of the Node.
+    Range prefix_range(std::string_view prefix) {
+      static_assert(is_string_key, "prefix_range() requires string keys");
+      return prefix_range_impl<iterator>(this, prefix);
+    }
+
+    ConstRange prefix_range(std::string_view prefix) const {
+      static_assert(is_string_key, "prefix_range() requires string keys");
+      return prefix_range_impl<const_iterator>(this, prefix);
+    }
+
+    // count_prefix returns the number of keys that start with the prefix, which is the value count of its Node
+    size_t count_prefix(std::string_view prefix) const {
+      static_assert(is_string_key, "count_prefix() requires string keys");
+      return count_prefix_impl(prefix);
+    }
+
+    // longest_prefix_match returns the longest key that is a prefix of the key, or end() if there is none.
+    // The keys that are prefixes of the key are Nodes on its path, so the deepest existing Node is found first,
+    // and the path is followed towards the root through the owners of the Levels. It takes at most one probe
+    // per digit, or for strings, a probe per halving of the path.
+    iterator longest_prefix_match(const key_type & key) {
+      return longest_prefix_match_impl<iterator>(this, make_lookup_key(key));
+    }
+
+    const_iterator longest_prefix_match(const key_type & key) const {
+      return longest_prefix_match_impl<const_iterator>(this, make_lookup_key(key));
+    }
+
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    iterator longest_prefix_match(const K & key) {
+      return longest_prefix_match_impl<iterator>(this, std::string_view(key));
+    }
+
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    const_iterator longest_prefix_match(const K & key) const {
+      return longest_prefix_match_impl<const_iterator>(this, std::string_view(key));
+    }
+
+    // The batched longest_prefix_match looks up the keys of a forward range in groups, and writes the results to
+    // out. The final Nodes of a group are prefetched before they are probed, so that their cache misses overlap.
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt longest_prefix_match(ForwardIt first, ForwardIt last, OutputIt out) {
+      return longest_prefix_match_range<iterator>(this, first, last, out);
+    }
+
+    template <typename ForwardIt, typename OutputIt>
+    OutputIt longest_prefix_match(ForwardIt first, ForwardIt last, OutputIt out) const {
+      return longest_prefix_match_range<const_iterator>(this, first, last, out);
+    }
+    
+    template <typename Q = mapped_type>
+    typename std::enable_if<!std::is_void<Q>::value, std::pair<iterator,bool>>::type insert_or_assign(const Key& k, Q && obj) {
+      auto [ node, head, it ] = create_nodes_for_key(k);
+      bool is_new = true;	
+      if (!node->get_payload()) {
+	node->set_payload(arena_.alloc());
+	if (head) head->set_payload(node->get_payload());
+	it.set_ptr(node->get_payload());
+	new (static_cast<void*>(node->get_payload())) value_type(k, std::move(obj));
+	num_final_entries_++;
+      } else {
+	*(node->get_payload()) = value_type(k, std::move(obj));
+	is_new = false;
+      }
+      return std::make_pair(it, is_new);
+    }
+
+    template <typename... Args>
+    std::pair<iterator,bool> emplace(Args&&... args) {
+      value_type vt{std::forward<Args>(args)...};
+      auto [ node, head, it ] = create_nodes_for_key(getFirstConst(vt));
+      bool is_new = true;
+      if (!node->get_payload()) {
+	it.set_ptr(store_value(node, head, std::move(vt)));
+	num_final_entries_++;
+      } else {
+	is_new = false;
+      }
+      return std::make_pair(it, is_new);
+    }
+
+    std::pair<iterator, bool> insert(const value_type& keyval) {
+      return emplace(keyval);
+    }
+
+    std::pair<iterator, bool> insert(value_type&& keyval) {
+      return emplace(std::move(keyval));
+    }
+
+    iterator insert(const_iterator hint, const value_type& keyval) {
+      return emplace_hint(hint, keyval);
+    }
+
+    iterator insert(const_iterator hint, value_type&& keyval) {
+      return emplace_hint(hint, std::move(keyval));
+    }
+
+    // emplace_hint uses the Level of the hint, if the key only differs from the hinted key by the last digit,
+    // and the hint is at its final Node rather than a head. The ancestors are then updated without probing.
+    // If the hint is end(), the previous value inserted with the end() hint is used instead, so that appending
+    // increasing keys is fast.
+    template <typename... Args>
+    iterator emplace_hint(const_iterator hint, Args&&... args) {
+      value_type vt{std::forward<Args>(args)...};
+      const value_type * hint_value = get_append_hint();
+      uint32_t hint_level = append_level_;
+      bool append = hint == cend();
+      if (!append) {
+	hint_value = &*hint;
+	hint_level = hint.get_depth() == keysize(getFirstConst(*hint_value), digits{}) ? hint.get_level() : no_level;
+      }
+      auto level = hint_value && shares_level(getFirstConst(vt), getFirstConst(*hint_value)) ? hint_level : no_level;
+      auto [ node, head, it ] = create_nodes_for_key(getFirstConst(vt), level);
+      if (!node->get_payload()) {
+	it.set_ptr(store_value(node, head, std::move(vt)));
+	num_final_entries_++;
+      }
+      if (append) {
+	append_hint_ = node->get_payload();
+	if constexpr (inline_payload) append_value_ = *append_hint_;
+	append_level_ = it.get_level();
+      }
+      return it;
+    }
+
+    template<class InputIt>
+    void insert(InputIt first, InputIt last) {
+      if constexpr (std::is_base_of<std::forward_iterator_tag, typename std::iterator_traits<InputIt>::iterator_category>::value) {
+	// the range can be traversed twice, so the table can be presized
+	size_t n = 0, total_keysize = 0;
+	for (auto it = first; it != last; ++it) {
+	  n++;
+	  total_keysize += keysize(getFirstConst(*it), digits{});
+	}
+	if (n) {
+	  reserve_nodes(estimate_node_count(size() + n, (total_keysize + n - 1) / n));
+	  if constexpr (!inline_payload) arena_.reserve(n);
+	}
+      }
+      while (first != last) {
+	insert(*first);
 	first++;
       }
     }
 
+    // assign replaces the contents with the values in the range. The values are sorted first,
+    // so that each Node is created with a single probe and the payloads are stored in key order.
+    // If the range contains equal keys, the first one is stored. A multi-pass range of values is sorted
+    // through indices into it, so only single-pass ranges and ranges of other types are copied first.
+    template<class InputIt>
+    void assign(InputIt first, InputIt last) {
+      clear();
+      using category = typename std::iterator_traits<InputIt>::iterator_category;
+      using reference = typename std::iterator_traits<InputIt>::reference;
+      if constexpr (!std::is_arithmetic<internal_key_type>::value && !is_string_key) {
+	insert(first, last);
+      } else if constexpr (std::is_base_of<std::forward_iterator_tag, category>::value && std::is_lvalue_reference<reference>::value &&
+			   std::is_same<typename std::decay<reference>::type, value_type>::value) {
+	if constexpr (std::is_base_of<std::random_access_iterator_tag, category>::value) {
+	  load_sorted(static_cast<size_t>(std::distance(first, last)), [&](size_t i) -> decltype(auto) { return first[static_cast<typename std::iterator_traits<InputIt>::difference_type>(i)]; });
+	} else {
+	  std::vector<InputIt> input;
+	  for (; first != last; ++first) input.push_back(first);
+	  load_sorted(input.size(), [&](size_t i) -> decltype(auto) { return *input[i]; });
+	}
+      } else {
+	std::vector<value_type> values(first, last);
+	load_sorted(values.size(), [&](size_t i) -> value_type && { return std::move(values[i]); });
+      }
+    }
+
+    // reserve makes room for n keys, so that they can be inserted without resizing the table.
+    // For variable length keys, such as strings, the number of digits per key is estimated.
+    void reserve(size_type n) {
+      size_t key_digits = keysize(key_type{}, digits{});
+      if (!key_digits) key_digits = default_keysize;
+      reserve_nodes(estimate_node_count(n, key_digits));
+      if (!inline_payload && n > size()) arena_.reserve(n - size());
+    }
+
+    // rehash sets the number of nodes in the table to at least n, and rehashes the table.
+    // The Nodes are moved by up to the given number of threads, serially by default, and small tables are
+    // always rehashed serially.
+    void rehash(size_type n, size_t threads = 1) {
+      check_writable();
+      size_t required = std::max(n, num_entries_ * 100 / max_load_factor100 + 1);
+      size_t s = bucket_count;
+      while (s < required) s *= 2;
+      if (!nodes_) {
+	init(s);
+      } else if (s != table_size_) {
+	resize(s, threads);
+      }
+    }
+
     template <typename Q = mapped_type>
-    typename std::enable_if<!std::is_void<Q>::value, Q&>::type operator[](const key_type& key) noexcept {
+    typename std::enable_if<!std::is_void<Q>::value, Q&>::type operator[](const key_type& key) {
       auto it = find(key);
       if (it != end()) {
 	return it->second;
@@ -751,6 +1993,8 @@ namespace radix_cpp {
     }
 
     iterator erase(iterator pos) {
+      check_writable();
+      if (old_nodes_) migrate(migration_step);
       auto node = pos.repair_and_get_node();
       if (!node->is_assigned() || !node->get_payload()) {
 #ifdef DEBUG
@@ -758,33 +2002,71 @@ namespace radix_cpp {
 #endif
 	abort();
       }
+      pos.restore_prefix_key(); // the prefix key can't be restored after the payload has been destroyed
+      append_hint_ = nullptr; // the Level of the hint might be freed
       auto next_pos = pos;
       ++next_pos;
 
-      node->get_payload()->~value_type();
-      arena_.dealloc(node->get_payload());
+      InlineValue copy;
+      auto payload = keep_payload(node, copy);
+      auto depth = pos.get_depth();
+      uint32_t level;
+      if (node->is_head()) {
+	// the final Node of a compressed path has no parent, so it is removed separately
+	release_node(find_final_node(make_lookup_key(getFirstConst(*payload))));
+	level = compact_nodes ? node->get_parent() : pos.get_level();
+      } else if (node->is_detached()) {
+	// continue from the head of the path
+	release_node(node);
+	auto [ ordinal, prefix_key ] = deconstruct(getFirstConst(*payload), digits{});
+	auto prefix_hash = calc_prefix_hash(depth, prefix_key);
+	size_t child_ordinal;
+	node = find_ancestor(depth, prefix_key, prefix_hash, ordinal, child_ordinal);
+	level = get_containing_level(node, depth, prefix_key, prefix_hash);
+      } else {
+	// the ancestors are reached through the Levels, starting from the Level containing the Node
+	level = !depth ? no_level : compact_nodes ? node->get_parent() : pos.get_level();
+      }
+
+      if constexpr (!inline_payload) {
+	payload->~value_type();
+	arena_.dealloc(payload);
+      }
       node->set_payload(nullptr);
       num_final_entries_--;
-	
-      if (node->dec_value_count()) {
-	node->get_prefix_key().~internal_key_type();
-	num_entries_--;
-	inserts_remaining_++;
-      }
-      
-      pos.down();
-      while ( pos.get_depth() ) {
-	auto node = read_node(pos.get_hash(), pos.get_offset());
-	if (node->dec_value_count()) {
-	  node->get_prefix_key().~internal_key_type();
-	  num_entries_--;
-	  inserts_remaining_++;
+
+      // removed is set when a Node becomes empty, so that it can be removed from the parent bitmap.
+      // The topmost Node that is left with a single key below it is where the path can be compressed.
+      auto ordinal = node->get_ordinal();
+      bool removed = release_node(node);
+      auto is_mergeable = [](const Node * n) { return n->get_value_count() == 1 && !n->get_payload() && n->get_children(); };
+      Node * merge_node = !removed && is_mergeable(node) ? node : nullptr;
+      size_t merge_depth = depth;
+      while (level != no_level) {
+	auto & l = levels_[level];
+	if (removed) l.unset(ordinal);
+	if (level == root_level) break;
+	auto parent = l.get_owner();
+	auto parent_level = l.get_parent();
+	if (removed && l.empty()) {
+	  free_level(level);
+	  parent->set_children(0);
 	}
-	pos.down();
+	ordinal = parent->get_ordinal();
+	removed = release_node(parent);
+	depth--;
+	if (!removed && is_mergeable(parent)) {
+	  merge_node = parent;
+	  merge_depth = depth;
+	}
+	level = parent_level;
       }
+      if (merge_node) merge_path(merge_node, merge_depth);
 
       if (table_size_ > bucket_count && get_load_factor() < min_load_factor100) { // Check the load factor
 	resize(table_size_ >> 1);
+      } else if (num_tombstones_ * 100 > table_size_ * max_tombstone_factor100) {
+	compact();
       }
       
       return next_pos;
@@ -807,6 +2089,17 @@ namespace radix_cpp {
       }
     }
 
+    template <typename K, typename std::enable_if<is_lookup_key<K>::value>::type* = nullptr>
+    size_t erase(const K & key) {
+      auto it = find(key);
+      if (it != end()) {
+	erase(it);
+	return 1;
+      } else {
+	return 0;
+      }
+    }
+
     iterator begin() noexcept {
       if (size()) {
 	iterator it(this);
@@ -835,10 +2128,243 @@ namespace radix_cpp {
       return const_iterator(this);
     }
 
+    reverse_iterator rbegin() noexcept {
+      return reverse_iterator(--end());
+    }
+    reverse_iterator rend() noexcept {
+      return reverse_iterator(end());
+    }
+
+    const_reverse_iterator crbegin() const noexcept {
+      return const_reverse_iterator(--cend());
+    }
+    const_reverse_iterator crend() const noexcept {
+      return const_reverse_iterator(cend());
+    }
+
+    // unordered_begin and unordered_end iterate over the keys in the order of the node arrays, which reads the
+    // memory sequentially and doesn't probe
+    unordered_iterator unordered_begin() noexcept {
+      return size() ? unordered_iterator(this) : unordered_iterator();
+    }
+    unordered_iterator unordered_end() noexcept {
+      return unordered_iterator();
+    }
+
+    const_unordered_iterator unordered_begin() const noexcept {
+      return size() ? const_unordered_iterator(this) : const_unordered_iterator();
+    }
+    const_unordered_iterator unordered_end() const noexcept {
+      return const_unordered_iterator();
+    }
+
+    // for_each_unordered calls f with each value in an unspecified order. The values in the Arena are visited
+    // page by page if it has no free slots, which is the case unless keys have been erased. Otherwise the node
+    // arrays are scanned like by unordered_begin().
+    template <typename F>
+    void for_each_unordered(F f) {
+      for_each_unordered_impl<iterator>(this, f);
+    }
+
+    template <typename F>
+    void for_each_unordered(F f) const {
+      for_each_unordered_impl<const_iterator>(this, f);
+    }
+
+    // back returns the last key, which is found by descending through the largest ordinals. The table must not be empty.
+    typename iterator::reference back() {
+      return *const_cast<value_type *>(find_last());
+    }
+    const value_type & back() const {
+      return *find_last();
+    }
+
     bool empty() const noexcept { return num_final_entries_ == 0; }
     size_t size() const noexcept { return num_final_entries_; }
     size_t num_inserts() const noexcept { return num_inserts_; }
     size_t num_insert_collisions() const noexcept { return num_insert_collisions_; }
+    size_t num_resizes() const noexcept { return num_resizes_; }
+    allocator_type get_allocator() const noexcept { return allocator_type(node_alloc_); }
+    size_t num_tombstones() const noexcept { return num_tombstones_; }
+
+    // compact removes the tombstones left by erased Nodes, so that the probe chains are as short as after
+    // a resize, without changing the size of the table. It is also done automatically by erase(), when
+    // the tombstones exceed a share of the table. An incremental resize in progress is finished first.
+    void compact() {
+      check_writable();
+      if (old_nodes_) migrate(old_mask_ + 1);
+      if (num_tombstones_) purge_tombstones();
+    }
+
+    // Tables whose keys and values are trivially copyable, and not strings, can be saved to a file and loaded back
+    // by mapping the file, without inserting or rehashing anything. The file is meant to be mapped at a base
+    // address, where the pointers stored in it are valid as they are, and elsewhere they are relocated.
+    static constexpr bool is_persistent = !is_string_key && std::is_trivially_copyable<Key>::value &&
+      (is_set || std::is_trivially_copyable<typename std::conditional<is_set, char, T>::type>::value);
+
+    // save writes the table to a file: a header, the node array, the Nodes of the first digit, the Levels and
+    // the payloads, each starting at a page boundary. The payloads are stored in the order of their final Nodes.
+    // If no base address is given, one is picked at random for the file, so that files saved separately can
+    // usually be loaded together at their own bases. An incremental resize in progress is finished first.
+    void save(const std::string & path, uintptr_t base = 0) {
+      static_assert(is_persistent, "only tables with trivially copyable keys and values can be saved");
+      if (old_nodes_) migrate(old_mask_ + 1);
+
+      // the final Nodes are numbered in the order of the node array followed by the Nodes of the first digit
+      size_t num_slots = nodes_ ? table_size_ + (direct_top ? bucket_count : 0) : 0;
+      auto get_slot = [&](size_t i) { return i < table_size_ ? nodes_ + i : top_ + (i - table_size_); };
+      auto get_index = [&](const Node * n) {
+	return n >= nodes_ && n < nodes_ + table_size_ ? static_cast<size_t>(n - nodes_) : table_size_ + static_cast<size_t>(n - top_);
+      };
+      std::vector<uint64_t> finals((num_slots + 63) / 64), ranks(finals.size());
+      size_t num_payloads = 0;
+      if constexpr (!inline_payload) {
+	for (size_t i = 0; i < num_slots; i++) {
+	  auto node = get_slot(i);
+	  if (node->is_assigned() && node->get_payload() && !node->is_head()) finals[i / 64] |= UINT64_C(1) << (i % 64);
+	}
+	for (size_t i = 0; i < finals.size(); i++) {
+	  ranks[i] = num_payloads;
+	  num_payloads += popcount(finals[i]);
+	}
+      }
+
+      FileHeader h = make_file_header();
+      h.table_size = nodes_ ? table_size_ : 0;
+      h.num_entries = num_entries_;
+      h.num_final_entries = num_final_entries_;
+      h.num_tombstones = num_tombstones_;
+      h.num_levels = levels_.size();
+      h.num_payloads = num_payloads;
+      h.nodes_offset = align_to_page(sizeof(FileHeader));
+      h.top_offset = align_to_page(h.nodes_offset + (nodes_ ? get_node_array_length(table_size_) * sizeof(Node) : 0));
+      h.levels_offset = align_to_page(h.top_offset + (nodes_ && direct_top ? bucket_count * sizeof(Node) : 0));
+      h.payloads_offset = align_to_page(h.levels_offset + levels_.size() * sizeof(Level));
+      h.file_size = h.payloads_offset + num_payloads * sizeof(value_type);
+      if (!base) base = pick_map_base(path, h.file_size);
+      h.base = base;
+
+      auto node_address = [&](const Node * n) {
+	auto i = get_index(n);
+	return i < table_size_ ? base + h.nodes_offset + i * sizeof(Node) : base + h.top_offset + (i - table_size_) * sizeof(Node);
+      };
+      auto payload_address = [&](size_t i) {
+	auto rank = ranks[i / 64] + popcount(finals[i / 64] & ((UINT64_C(1) << (i % 64)) - 1));
+	return base + h.payloads_offset + rank * sizeof(value_type);
+      };
+
+      std::unique_ptr<std::FILE, int (*)(std::FILE *)> f(std::fopen(path.c_str(), "wb"), std::fclose);
+      if (!f) throw std::system_error(errno, std::generic_category(), path);
+      size_t written = 0;
+      auto write = [&](const void * data, size_t size, size_t offset) {
+	static const char zeros[4096] = { };
+	for (; written < offset; written += std::min(offset - written, sizeof(zeros))) {
+	  if (std::fwrite(zeros, 1, std::min(offset - written, sizeof(zeros)), f.get()) != std::min(offset - written, sizeof(zeros))) {
+	    throw std::system_error(errno, std::generic_category(), path);
+	  }
+	}
+	if (size && std::fwrite(data, 1, size, f.get()) != size) throw std::system_error(errno, std::generic_category(), path);
+	written += size;
+      };
+      write(&h, sizeof(h), 0);
+
+      // the Nodes are copied a chunk at a time, and their payload pointers are replaced
+      constexpr size_t chunk_size = 4096;
+      std::vector<Node> chunk(chunk_size);
+      auto write_nodes = [&](const Node * nodes, size_t n, size_t offset) {
+	for (size_t i = 0; i < n; i += chunk_size) {
+	  size_t m = std::min(chunk_size, n - i);
+	  std::memcpy(static_cast<void*>(chunk.data()), nodes + i, m * sizeof(Node));
+	  if constexpr (!inline_payload) {
+	    for (size_t j = 0; j < m; j++) {
+	      auto & node = chunk[j];
+	      if (!node.is_assigned() || !node.get_payload()) continue;
+	      auto final_node = node.is_head() ? find_final_node(make_lookup_key(getFirstConst(*node.get_payload()))) : nodes + i + j;
+	      node.set_payload(reinterpret_cast<value_type *>(payload_address(get_index(final_node))));
+	    }
+	  }
+	  write(chunk.data(), m * sizeof(Node), offset + i * sizeof(Node));
+	}
+      };
+      if (nodes_) {
+	write_nodes(nodes_, table_size_, h.nodes_offset);
+	write(get_ctrl(nodes_, table_size_), table_size_ + ControlGroup::width - 1, h.nodes_offset + table_size_ * sizeof(Node));
+	if (direct_top) write_nodes(top_, bucket_count, h.top_offset);
+      }
+
+      // the owners of the Levels are replaced, and those of the free Levels may be out of date
+      for (size_t i = 0; i < levels_.size(); i++) {
+	Level level = levels_[i];
+	auto owner = level.get_owner();
+	bool valid = owner && ((owner >= nodes_ && owner < nodes_ + table_size_) || is_top_node(owner));
+	level.set_owner(valid ? reinterpret_cast<Node *>(node_address(owner)) : nullptr);
+	write(&level, sizeof(Level), h.levels_offset + i * sizeof(Level));
+      }
+
+      write(nullptr, 0, h.payloads_offset);
+      for (size_t i = 0; i < num_slots; i++) {
+	if (finals[i / 64] & (UINT64_C(1) << (i % 64))) write(get_slot(i)->get_payload(), sizeof(value_type), written);
+      }
+      write(nullptr, 0, h.file_size);
+      if (std::fflush(f.get()) != 0) throw std::system_error(errno, std::generic_category(), path);
+    }
+
+#ifdef __linux__
+    // load replaces the contents with a table saved to the file, which is mapped privately. The table can be
+    // searched and iterated, and the values changed in place (copy-on-write, the file isn't modified), but keys
+    // can't be inserted or erased until clear() or assign() releases the mapping. If the base address of the
+    // file is taken, the file is mapped elsewhere, and the pointers are relocated and checked against the
+    // sections of the file. Otherwise only the header is checked, so the file must be trusted.
+    void load(const std::string & path) {
+      static_assert(is_persistent, "only tables with trivially copyable keys and values can be loaded");
+      int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0) throw std::system_error(errno, std::generic_category(), path);
+      FileHeader h, expected = make_file_header();
+      struct stat st;
+      bool valid = ::pread(fd, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h)) && ::fstat(fd, &st) == 0 &&
+	std::memcmp(&h, &expected, offsetof(FileHeader, base)) == 0 && static_cast<uint64_t>(st.st_size) >= h.file_size &&
+	is_valid_layout(h);
+      if (!valid) {
+	::close(fd);
+	throw std::runtime_error(path + ": not a compatible radix_cpp table");
+      }
+      auto hint = reinterpret_cast<void *>(static_cast<uintptr_t>(h.base));
+      auto p = ::mmap(hint, h.file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      int e = errno;
+      ::close(fd);
+      if (p == MAP_FAILED) throw std::system_error(e, std::generic_category(), path);
+
+      clear();
+      auto base = static_cast<char *>(p);
+      mapping_ = p;
+      mapping_size_ = h.file_size;
+      table_size_ = h.table_size;
+      table_mask_ = table_size_ ? table_size_ - 1 : 0;
+      nodes_ = table_size_ ? reinterpret_cast<Node *>(base + h.nodes_offset) : nullptr;
+      top_ = table_size_ && direct_top ? reinterpret_cast<Node *>(base + h.top_offset) : nullptr;
+      num_entries_ = h.num_entries;
+      num_final_entries_ = h.num_final_entries;
+      num_tombstones_ = h.num_tombstones;
+      levels_.map(reinterpret_cast<Level *>(base + h.levels_offset), h.num_levels);
+      if (p != hint) {
+	try {
+	  relocate(reinterpret_cast<uintptr_t>(p) - static_cast<uintptr_t>(h.base), h);
+	} catch (...) {
+	  clear();
+	  throw;
+	}
+      }
+    }
+#endif
+
+    // returns true if the table has been loaded from a file and is read-only
+    bool is_mapped() const noexcept { return mapping_ != nullptr; }
+
+    // In the incremental resize mode the old node array is kept during resizing, and the Nodes are moved
+    // to the new array a few at a time by the following inserts and erases. This bounds the latency of a
+    // single insert, at the cost of probing both arrays during the resize.
+    void set_incremental_resize(bool enabled) noexcept { incremental_resize_ = enabled; }
+    bool get_incremental_resize() const noexcept { return incremental_resize_; }
     
   private:
     class Arena {
@@ -846,20 +2372,17 @@ namespace radix_cpp {
       static constexpr size_t page_size = 4096;
       
     public:
-      Arena() { }
+      explicit Arena(const Allocator & alloc) noexcept : alloc_(alloc), pages_(alloc), free_list_(alloc) { }
       Arena(Arena && other) noexcept
 	: n_(std::exchange(other.n_, 0)),
-	  pages_(std::move(other.pages_)) { }
+	  pages_in_use_(std::exchange(other.pages_in_use_, 0)),
+	  alloc_(other.alloc_),
+	  pages_(std::move(other.pages_)),
+	  free_list_(std::move(other.free_list_)) { }
       ~Arena() noexcept {
 	clear();
       }
 
-      Arena & operator=(Arena && other) noexcept {
-	std::swap(n_, other.n);
-	std::swap(pages_, other.pages_);
-	return *this;
-      }
-    
       Arena(const Arena & other) = delete;
       Arena& operator=(const Arena & other) = delete;
 
@@ -869,13 +2392,24 @@ namespace radix_cpp {
 	  free_list_.pop_back();
 	  return ptr;
 	} else {
-	  if (pages_.empty() || n_ == page_size) {
-	    auto p = reinterpret_cast<value_type*>(std::malloc(page_size * sizeof(value_type)));
-	    if (!p) throw std::bad_alloc();
-	    pages_.push_back(p);
+	  if (!pages_in_use_ || n_ == page_size) {
+	    if (pages_in_use_ == pages_.size()) {
+	      add_page();
+	    }
+	    pages_in_use_++;
 	    n_ = 0;
 	  }
-	  return pages_.back() + n_++;
+	  return pages_[pages_in_use_ - 1] + n_++;
+	}
+      }
+
+      // reserve allocates the pages for n more values up front
+      void reserve(size_t n) {
+	size_t available = free_list_.size() + (pages_.size() - pages_in_use_) * page_size;
+	if (pages_in_use_) available += page_size - n_;
+	while (available < n) {
+	  add_page();
+	  available += page_size;
 	}
       }
 
@@ -883,85 +2417,1228 @@ namespace radix_cpp {
 	free_list_.push_back(ptr);
       }
 
+      // returns the number of allocated values
+      size_t size() const noexcept {
+	return pages_in_use_ ? (pages_in_use_ - 1) * page_size + n_ - free_list_.size() : 0;
+      }
+
+      bool has_free_slots() const noexcept { return !free_list_.empty(); }
+
+      // calls f with each allocated value, page by page. There must be no free slots.
+      template <typename F>
+      void for_each(F f) const {
+	for (size_t i = 0; i < pages_in_use_; i++) {
+	  auto page = pages_[i];
+	  for (size_t j = 0, n = i + 1 == pages_in_use_ ? n_ : page_size; j < n; j++) f(page[j]);
+	}
+      }
+
       void clear() noexcept {
 	for (size_t i = 0; i < pages_.size(); i++) {
-	  std::free(pages_[i]);
+	  std::allocator_traits<rebind_alloc<value_type>>::deallocate(alloc_, pages_[i], page_size);
 	}
-	n_ = 0;
-	pages_.clear();	
+	n_ = pages_in_use_ = 0;
+	pages_.clear();
+	free_list_.clear();
       }
       
     private:
-      size_t n_ = 0;
-      std::vector<value_type*> pages_;
-      std::vector<value_type*> free_list_;
+      void add_page() {
+	pages_.push_back(std::allocator_traits<rebind_alloc<value_type>>::allocate(alloc_, page_size));
+      }
+
+      size_t n_ = 0, pages_in_use_ = 0;
+      rebind_alloc<value_type> alloc_;
+      std::vector<value_type*, rebind_alloc<value_type*>> pages_;
+      std::vector<value_type*, rebind_alloc<value_type*>> free_list_;
     };
 
-    size_t get_load_factor() const noexcept { return 100 * num_entries_ / table_size_; }
-    size_t get_inserts_until_rehash() const noexcept {
-      size_t max_entries = max_load_factor100 * table_size_ / 100;
-      if (num_entries_ > max_entries) return 0;
-      else return max_entries - num_entries_;
-    }
+    // LevelPool stores the Levels in fixed size pages, so that growing it never moves the existing Levels
+    class LevelPool {
+    private:
+      static constexpr size_t page_size = bucket_count <= 256 ? 4096 : 4096 * 256 / bucket_count; // wide Levels get smaller pages
 
-    std::tuple<Node *, size_t, size_t, size_t> create_node(size_t depth, const internal_key_type & prefix_key, size_t ordinal) {
-      if (!inserts_remaining_) {
-	resize(table_size_ * 2);
+    public:
+      explicit LevelPool(const Allocator & alloc) noexcept : alloc_(alloc), pages_(alloc) { }
+      LevelPool(LevelPool && other) noexcept
+	: size_(std::exchange(other.size_, 0)),
+	  mapped_(std::exchange(other.mapped_, false)),
+	  alloc_(other.alloc_),
+	  pages_(std::move(other.pages_)) { }
+      ~LevelPool() noexcept {
+	clear();
       }
 
-      auto hash0 = calc_unordered_hash(depth, prefix_key);
-      auto hash = calc_final_hash(hash0, ordinal);
-      auto node_initial = read_node(hash);
-      auto nodes_start = get_nodes_start(), nodes_end = get_nodes_end();
-      
-      auto node = node_initial;
-      while ( 1 ) {
-	if (!node->is_assigned()) { // unassigned or tombstone
-	  node->assign(depth, prefix_key, ordinal);
-	  num_entries_++;
-	  inserts_remaining_--;
-	} else if (!node->equals(depth, prefix_key, ordinal)) {
-	  // collision
-	  if (++node == nodes_end) node = nodes_start;
-	  num_insert_collisions_++;
-	  continue;
-	} else {
-	  node->inc_value_count();
+      LevelPool(const LevelPool & other) = delete;
+      LevelPool& operator=(const LevelPool & other) = delete;
+
+      Level & operator[](size_t i) noexcept { return pages_[i / page_size][i % page_size]; }
+      const Level & operator[](size_t i) const noexcept { return pages_[i / page_size][i % page_size]; }
+      size_t size() const noexcept { return size_; }
+
+      Level & emplace_back() {
+	if (size_ == pages_.size() * page_size) {
+	  add_page();
 	}
-	break;
+	return (*this)[size_++];
       }
-      return std::tuple(node, hash0, hash, static_cast<size_t>(node - node_initial));
-    }
 
-    std::pair<Node *, iterator> create_nodes_for_key(key_type key0) {
-      if (!nodes_) {
-	init(bucket_count);
+      void reserve(size_t n) {
+	while (pages_.size() * page_size < n) {
+	  add_page();
+	}
       }
-      auto n = keysize(key0);
-      auto [ ordinal, prefix_key ] = deconstruct(std::move(key0));
 
-      num_inserts_++;
+      void clear() noexcept {
+	if (!mapped_) {
+	  for (size_t i = 0; i < pages_.size(); i++) {
+	    std::allocator_traits<rebind_alloc<Level>>::deallocate(alloc_, pages_[i], page_size);
+	  }
+	}
+	size_ = 0;
+	mapped_ = false;
+	pages_.clear();
+      }
 
-      auto depth = n;
-      
-      auto first_prefix_key = prefix_key;
-      auto first_ordinal = ordinal;
-      	
-      // first insert the tail from least significant digit to most significant
-      for ( size_t i = 1; i < n; i++) {
-	auto [ next_ordinal, next_prefix_key ] = deconstruct(std::move(prefix_key));
-	ordinal = next_ordinal;
-	prefix_key = std::move(next_prefix_key);
-	depth--;
+      // map uses n Levels stored contiguously elsewhere, which are not released by clear
+      void map(Level * levels, size_t n) {
+	clear();
+	for (size_t i = 0; i < n; i += page_size) {
+	  pages_.push_back(levels + i);
+	}
+	size_ = n;
+	mapped_ = true;
+      }
 
-	create_node(depth, prefix_key, ordinal);
+    private:
+      void add_page() {
+	pages_.push_back(std::allocator_traits<rebind_alloc<Level>>::allocate(alloc_, page_size));
       }
 
-      // then insert the head
-      auto [ node, hash0, hash, offset ] = create_node(n, first_prefix_key, first_ordinal);
-      auto it = iterator(this, node->get_payload(), n, std::move(first_prefix_key), first_ordinal, offset, hash0, hash);
-      return std::pair(node, it);
-    }
+      size_t size_ = 0;
+      bool mapped_ = false;
+      rebind_alloc<Level> alloc_;
+      std::vector<Level*, rebind_alloc<Level*>> pages_;
+    };
+
+    // estimates the number of nodes needed for n keys with given number of digits. Depth d
+    // can contain at most 256^d nodes, and at most n nodes. Below the first depth that can hold
+    // n nodes the paths are compressed, so each key needs at most a head and a final Node.
+    static size_t estimate_node_count(size_t n, size_t digits) noexcept {
+      size_t total = 0, level_size = 1;
+      for (size_t d = 1; d <= digits; d++) {
+	if (level_size > n / bucket_count) return total + std::min(digits - d + 1, size_t(2)) * n;
+	level_size *= bucket_count;
+	total += level_size;
+      }
+      return total;
+    }
+
+    // makes room for n nodes, and the nodes of one more key. The table is never shrunk.
+    void reserve_nodes(size_t n) {
+      check_writable();
+      n += std::max(keysize(key_type{}, digits{}), default_keysize) + 1;
+      size_t required = (n * 100 + max_load_factor100 - 1) / max_load_factor100 + 1;
+      if (required > table_size_) {
+	rehash(required);
+      }
+    }
+
+    size_t get_load_factor() const noexcept { return 100 * num_entries_ / table_size_; }
+    size_t get_inserts_until_rehash() const noexcept {
+      size_t max_entries = max_load_factor100 * table_size_ / 100;
+      if (num_entries_ > max_entries) return 0;
+      else return max_entries - num_entries_;
+    }
+
+    std::tuple<Node *, size_t, size_t, bool> create_node(size_t depth, const internal_key_type & prefix_key, size_t prefix_hash, size_t ordinal, uint32_t level = no_level) {
+      auto hash = calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal);
+      if (direct_top && depth == 1) {
+	auto node = top_ + ordinal;
+	if (node->is_assigned()) return std::tuple(node, hash, 0, false);
+	node->assign(depth, prefix_key, ordinal, hash);
+	return std::tuple(node, hash, 0, true);
+      }
+      if (old_nodes_) {
+	// the Node might not have been moved yet
+	if (auto node = probe(old_nodes_, old_mask_, hash, depth, prefix_key, ordinal, level)) {
+	  return std::tuple(node, hash, 0, false);
+	}
+      }
+      // the home slot is tested first, and then the groups of control bytes after it, until a group has an empty
+      // slot. The Node might still exist after a tombstone, but the new Node is stored in the first free slot.
+      auto tag = get_tag(hash);
+      auto home = read_node(hash);
+      size_t free_offset = 0;
+      if (home->is_assigned() || home->is_tombstone()) {
+	if (home->is_assigned()) {
+	  if (home->equals(depth, prefix_key, ordinal, hash) && matches(home, depth, prefix_key, level)) {
+	    return std::tuple(home, hash, 0, false);
+	  }
+	  free_offset = SIZE_MAX;
+	}
+	auto ctrl = get_ctrl(nodes_, table_size_);
+	for (size_t offset = 1; offset < table_size_; offset += ControlGroup::width) {
+	  ControlGroup group(ctrl + ((hash + offset) & table_mask_));
+	  for (auto m = group.match(tag); m; m &= m - 1) {
+	    auto node_offset = offset + ControlGroup::index(m);
+	    auto node = read_node(hash, node_offset);
+	    if (node->equals(depth, prefix_key, ordinal, hash) && matches(node, depth, prefix_key, level)) {
+	      return std::tuple(node, hash, node_offset & table_mask_, false);
+	    }
+	  }
+	  if (free_offset == SIZE_MAX) {
+	    if (auto m = group.match_free()) free_offset = offset + ControlGroup::index(m);
+	  }
+	  if (group.match(ctrl_empty)) break;
+	}
+      }
+
+      free_offset &= table_mask_;
+      auto node = read_node(hash, free_offset);
+      if (node->is_tombstone()) num_tombstones_--;
+      node->assign(depth, prefix_key, ordinal, hash);
+      set_ctrl(nodes_, table_mask_, static_cast<size_t>(node - nodes_), tag);
+      num_entries_++;
+      inserts_remaining_--;
+      num_insert_collisions_ += free_offset;
+      return std::tuple(node, hash, free_offset, true);
+    }
+
+    // create_nodes_for_key creates the Nodes of the key, or finds the existing ones, and updates the value counts.
+    // If the Level containing the final Node is known (from a hint), the ancestors are not probed at all. Otherwise
+    // the deepest existing ancestor is probed from the least significant digit upwards, and the counts of the rest
+    // are updated by following the owners of the Levels. If the rest of the key would need three or more Nodes,
+    // only a head Node holding the payload is created below the ancestor, and the final Node is detached.
+    // The head is returned, so that the caller can store the payload in it as well.
+    std::tuple<Node *, Node *, iterator> create_nodes_for_key(const key_type & key0, uint32_t level = no_level) {
+      check_writable();
+      check_digits(key0);
+      if (!nodes_) {
+	init(bucket_count);
+      }
+      auto n = keysize(key0, digits{});
+      auto [ ordinal, prefix_key ] = deconstruct(key0, digits{});
+
+      num_inserts_++;
+      if (old_nodes_) migrate(migration_step + 2 * n); // enough to finish before the new array fills up
+
+      // make room for all the nodes of the key, and the Nodes of a split path, so that the node pointers stay valid
+      while (inserts_remaining_ <= n + 2) {
+	resize(table_size_ * 2);
+      }
+
+      // first insert the final Node. The prefix hash is calculated once, and then truncated by one digit at each level
+      auto prefix_hash = calc_prefix_hash(n, prefix_key);
+      auto [ node, hash, offset, is_new ] = create_node(n, prefix_key, prefix_hash, ordinal);
+      auto it = iterator(this, node->get_payload(), n, prefix_key, ordinal, offset, prefix_hash, hash);
+
+      if (!is_new) {
+	if (node->is_head()) {
+	  // the key is a prefix of the key held by the head, which is moved below it
+	  split_path(node, n, std::move(prefix_key), prefix_hash, key0, node);
+	} else if (node->get_payload()) {
+	  return std::tuple(node, nullptr, it); // the key exists already
+	} else {
+	  // a non-final Node has children, so all of its ancestors exist
+	  node->inc_value_count();
+	  inc_ancestors(levels_[node->get_children()].get_parent());
+	}
+	return std::tuple(node, nullptr, it);
+      } else if (!n) {
+	return std::tuple(node, nullptr, it); // the empty key has no parent
+      } else if (level != no_level) {
+	levels_[level].set(ordinal);
+	node->set_parent(level);
+	inc_ancestors(level);
+	it.set_level(level);
+	return std::tuple(node, nullptr, it);
+      }
+
+      // then find the deepest ancestor that exists, and attach the rest of the key to it
+      auto depth = n;
+      size_t child_ordinal = ordinal;
+      auto parent = find_ancestor(depth, prefix_key, prefix_hash, ordinal, child_ordinal);
+      std::pair<Node *, uint32_t> attached;
+      if (parent && parent->is_head()) {
+	attached = split_path(parent, depth, std::move(prefix_key), prefix_hash, key0, node);
+      } else if (parent) {
+	auto parent_level = get_containing_level(parent, depth, prefix_key, prefix_hash);
+	prefix_key = append(std::move(prefix_key), ordinal, digits{});
+	prefix_hash = extend_prefix_hash(prefix_hash, ordinal);
+	attached = attach_path(parent, parent_level, depth, std::move(prefix_key), prefix_hash, child_ordinal, n, node);
+	parent->inc_value_count();
+	inc_ancestors(parent_level);
+      } else {
+	attached = attach_path(nullptr, no_level, 0, std::move(prefix_key), prefix_hash, ordinal, n, node);
+      }
+      it.set_level(attached.second);
+      return std::tuple(node, attached.first, it);
+    }
+
+    // find_ancestor moves the position on the path of a key (depth, prefix key, prefix hash and ordinal) towards the
+    // root, until it is at an existing Node that isn't detached, and returns the Node. The ordinal of the previous
+    // position is left in child_ordinal. If there is no such Node, null is returned, and the position is at depth 1.
+    template <typename K>
+    Node * find_ancestor(size_t & depth, K & prefix_key, size_t & prefix_hash, size_t & ordinal, size_t & child_ordinal) const {
+      if constexpr (is_string_key) {
+	if (depth > 2) {
+	  // the existing Nodes on the path are a prefix of it, so the deepest one is found by binary search
+	  // the prefix hash is moved along the path in place, since the hash is invertible
+	  std::string_view path(prefix_key);
+	  size_t lo = 0, hi = depth, len = depth - 1;
+	  Node * found = nullptr;
+	  auto seek_prefix_hash = [&](size_t n) {
+	    for (; len > n; len--) prefix_hash = truncate_prefix_hash(prefix_hash, static_cast<uint8_t>(path[len - 1]));
+	    for (; len < n; len++) prefix_hash = extend_prefix_hash(prefix_hash, static_cast<uint8_t>(path[len]));
+	  };
+	  while (hi - lo > 1) {
+	    auto mid = (lo + hi) / 2;
+	    auto mid_ordinal = static_cast<uint8_t>(path[mid - 1]);
+	    auto mid_prefix = path.substr(0, mid - 1);
+	    seek_prefix_hash(mid - 1);
+	    auto node = find_node(calc_final_hash(calc_unordered_hash(mid, prefix_hash), mid_ordinal), mid, mid_prefix, mid_ordinal);
+	    if (node && !node->is_detached()) {
+	      lo = mid;
+	      found = node;
+	    } else {
+	      hi = mid;
+	    }
+	  }
+	  auto d = std::max(lo, size_t(1));
+	  child_ordinal = d + 1 < depth ? static_cast<uint8_t>(path[d]) : ordinal;
+	  ordinal = static_cast<uint8_t>(path[d - 1]);
+	  seek_prefix_hash(d - 1);
+	  if constexpr (std::is_same<K, std::string_view>::value) {
+	    prefix_key = path.substr(0, d - 1);
+	  } else {
+	    prefix_key.erase(d - 1);
+	  }
+	  depth = d;
+	  return found;
+	}
+      }
+      while (depth > 1) {
+	auto [ next_ordinal, next_prefix_key ] = deconstruct(std::move(prefix_key), digits{});
+	child_ordinal = ordinal;
+	ordinal = next_ordinal;
+	prefix_key = std::move(next_prefix_key);
+	prefix_hash = truncate_prefix_hash(prefix_hash, ordinal);
+	depth--;
+	auto node = find_node(calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal), depth, prefix_key, ordinal);
+	if (node && !node->is_detached()) return node;
+      }
+      return nullptr;
+    }
+
+    // init_path splits the path of a key of bounded size into the positions of its Nodes, from the final Node
+    // (at the given position) to the root, so that the deepest existing Node can be found by binary search
+    template <typename K>
+    void init_path(BoundedPath & path, size_t depth, const K & prefix_key, size_t prefix_hash, size_t ordinal) const {
+      path.prefix_keys[depth] = prefix_key;
+      path.ordinals[depth] = ordinal;
+      path.prefix_hashes[depth] = prefix_hash;
+      for (size_t d = depth; d > 1; d--) {
+	auto [ parent_ordinal, parent_prefix_key ] = deconstruct(path.prefix_keys[d], digits{});
+	path.ordinals[d - 1] = parent_ordinal;
+	path.prefix_keys[d - 1] = parent_prefix_key;
+	path.prefix_hashes[d - 1] = truncate_prefix_hash(path.prefix_hashes[d], parent_ordinal);
+      }
+      path.lo = 0;
+      path.hi = depth;
+      path.found = nullptr;
+    }
+
+    size_t get_path_hash(const BoundedPath & path, size_t depth) const noexcept {
+      return calc_final_hash(calc_unordered_hash(depth, path.prefix_hashes[depth]), path.ordinals[depth]);
+    }
+
+    // bisect_step probes the Node in the middle of the search range, and keeps the half containing the deepest
+    // existing Node. The Nodes that aren't detached exist from the root down to some depth, so the search works
+    // like that of find_ancestor for strings.
+    void bisect_step(BoundedPath & path) const {
+      auto mid = path.mid();
+      auto node = find_node(get_path_hash(path, mid), mid, path.prefix_keys[mid], path.ordinals[mid]);
+      if (node && !node->is_detached()) {
+	path.lo = mid;
+	path.found = node;
+      } else {
+	path.hi = mid;
+      }
+    }
+
+    // get_containing_level returns the Level that holds the Node at given depth and prefix
+    uint32_t get_containing_level(const Node * node, size_t depth, const internal_key_type & prefix_key, size_t prefix_hash) const noexcept {
+      if constexpr (compact_nodes) return node->get_parent();
+      return node->get_children() ? levels_[node->get_children()].get_parent() : find_level(depth, prefix_key, prefix_hash);
+    }
+
+    // get_child_level returns the Level of the children of the Node, which is allocated if the Node has none.
+    // A null Node is the root.
+    uint32_t get_child_level(Node * node, uint32_t node_level) {
+      if (!node) return root_level;
+      if (!node->get_children()) {
+	node->set_children(alloc_level(node));
+	levels_[node->get_children()].set_parent(node_level);
+      }
+      return node->get_children();
+    }
+
+    // attach_path links the final Node of a key with n digits below the parent at depth p, whose Level is parent_level.
+    // The prefix key, prefix hash and ordinal are those of the Node at depth p + 1. If two or fewer Nodes are needed
+    // they are linked normally, and otherwise a head Node is created at depth p + 1 and the final Node is detached.
+    // Returns the head or null, and the Level containing the final Node (or no_level if it is detached).
+    std::pair<Node *, uint32_t> attach_path(Node * parent, uint32_t parent_level, size_t p, internal_key_type prefix_key, size_t prefix_hash, size_t ordinal, size_t n, Node * final_node) {
+      auto level = get_child_level(parent, parent_level);
+      levels_[level].set(ordinal);
+      if (n - p >= 3) {
+	auto head = std::get<0>(create_node(p + 1, prefix_key, prefix_hash, ordinal));
+	head->set_head(true);
+	head->set_parent(level);
+	final_node->set_detached(true);
+	final_node->set_parent(no_level);
+	return std::pair(head, no_level);
+      }
+      if (n - p == 2) {
+	auto node = std::get<0>(create_node(p + 1, prefix_key, prefix_hash, ordinal));
+	node->set_parent(level);
+	level = get_child_level(node, level);
+	levels_[level].set(final_node->get_ordinal());
+      }
+      final_node->set_detached(false);
+      final_node->set_parent(level);
+      return std::pair(nullptr, level);
+    }
+
+    // split_path turns the head at depth b back into a normal Node when another key (whose final Node is given)
+    // is inserted below it. The Nodes shared by the two keys are created below the head, and the rest of both keys
+    // are attached to the last shared Node. The prefix key and prefix hash are those of the head. Returns the
+    // head of the new key or null, and the Level containing its final Node.
+    std::pair<Node *, uint32_t> split_path(Node * head, size_t b, internal_key_type prefix_key, size_t prefix_hash, const key_type & key2, Node * node2) {
+      InlineValue copy;
+      auto payload = keep_payload(head, copy);
+      KeyDigits key_digits(getFirstConst(*payload)), key2_digits(key2);
+      auto leaf = find_final_node(make_lookup_key(getFirstConst(*payload)));
+      size_t m = 0;
+      while (m < key_digits.size() && m < key2_digits.size() && key_digits[m] == key2_digits[m]) m++;
+
+      auto head_level = get_containing_level(head, b, prefix_key, prefix_hash);
+      head->set_payload(nullptr);
+      head->set_head(false);
+
+      // create the shared Nodes, each of which has both keys below
+      Node * parent = head;
+      uint32_t parent_level = head_level;
+      prefix_key = append(std::move(prefix_key), head->get_ordinal(), digits{});
+      prefix_hash = extend_prefix_hash(prefix_hash, head->get_ordinal());
+      for (size_t d = b + 1; d <= m; d++) {
+	// the final Nodes of the keys exist already, but compact Nodes can't be found before they are linked
+	auto ordinal = key2_digits[d - 1];
+	auto node = d == key2_digits.size() ? node2 : d == key_digits.size() ? leaf : std::get<0>(create_node(d, prefix_key, prefix_hash, ordinal));
+	node->inc_value_count();
+	node->set_detached(false);
+	auto level = get_child_level(parent, parent_level);
+	levels_[level].set(ordinal);
+	node->set_parent(level);
+	parent = node;
+	parent_level = level;
+	prefix_key = append(std::move(prefix_key), ordinal, digits{});
+	prefix_hash = extend_prefix_hash(prefix_hash, ordinal);
+      }
+
+      if (m < key_digits.size()) {
+	auto attached = attach_path(parent, parent_level, m, prefix_key, prefix_hash, key_digits[m], key_digits.size(), leaf);
+	if (attached.first) attached.first->set_payload(payload);
+      }
+      std::pair<Node *, uint32_t> attached(nullptr, no_level);
+      if (m < key2_digits.size()) {
+	attached = attach_path(parent, parent_level, m, std::move(prefix_key), prefix_hash, key2_digits[m], key2_digits.size(), node2);
+      }
+      head->inc_value_count();
+      inc_ancestors(head_level);
+      return attached;
+    }
+
+    // merge_path compresses the path below a Node that has a single key left below it. The Node becomes the head
+    // of the key, the Nodes between them are removed, and the final Node of the key is detached.
+    void merge_path(Node * top, size_t depth) {
+      auto top_depth = depth;
+      auto prefix_key = get_node_prefix_key(top, depth);
+      auto prefix_hash = extend_prefix_hash(calc_prefix_hash(depth, prefix_key), top->get_ordinal());
+      prefix_key = append(std::move(prefix_key), top->get_ordinal(), digits{});
+      // the Levels on the way down have a single child
+      std::vector<Node *> path;
+      Node * node = top;
+      while (!node->get_payload()) {
+	auto level = node->get_children();
+	auto ordinal = levels_[level].next(0);
+	depth++;
+	node = find_node(calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal), depth, prefix_key, ordinal, level);
+	path.push_back(node);
+	prefix_key = append(std::move(prefix_key), ordinal, digits{});
+	prefix_hash = extend_prefix_hash(prefix_hash, ordinal);
+      }
+      InlineValue copy;
+      auto payload = keep_payload(node, copy); // the Node may be released below
+      Node * leaf;
+      if (node->is_head()) {
+	leaf = find_final_node(make_lookup_key(getFirstConst(*payload)));
+      } else if (depth - top_depth >= 2) {
+	leaf = node;
+	path.pop_back();
+      } else {
+	return; // the key is a child of the top Node
+      }
+
+      for (auto n : path) {
+	if (n->get_children()) free_level(n->get_children());
+	release_node(n);
+      }
+      free_level(top->get_children());
+      top->set_children(0);
+      top->set_payload(payload);
+      top->set_head(true);
+      leaf->set_detached(true);
+      leaf->set_parent(no_level);
+      num_merges_++;
+    }
+
+    // get_node_prefix_key returns the prefix key of a Node at given depth that isn't detached. The prefix
+    // of a compact Node is collected from the owners of the Levels on the way to the root.
+    internal_key_type get_node_prefix_key(const Node * node, size_t depth) const {
+      if constexpr (compact_nodes) {
+	internal_key_type prefix_key(depth ? depth - 1 : 0, '\0');
+	auto level = node->get_parent();
+	for (size_t i = prefix_key.size(); i > 0; i--) {
+	  auto & l = levels_[level];
+	  prefix_key[i - 1] = static_cast<char>(l.get_owner()->get_ordinal());
+	  level = l.get_parent();
+	}
+	return prefix_key;
+      } else {
+	return node->get_prefix_key();
+      }
+    }
+
+    // find_final_node returns the Node at the full depth of the key, or null if there is none
+    template <typename K>
+    Node * find_final_node(const K & key) const noexcept {
+      auto [ ordinal, prefix_key ] = deconstruct(key, digits{});
+      auto depth = keysize(key, digits{});
+      auto hash = calc_final_hash(calc_unordered_hash(depth, calc_prefix_hash(depth, prefix_key)), ordinal);
+      return find_node(hash, depth, prefix_key, ordinal);
+    }
+
+    // KeyDigits holds the digits of a key, the most significant first. The digits of string keys are read from a
+    // view of the key, and the digits of other keys are stored in place, since there are a bounded number of them.
+    class KeyDigits {
+    public:
+      template <typename K>
+      explicit KeyDigits(const K & key) noexcept : size_(keysize(key, digits{})) {
+	if constexpr (is_string_key) {
+	  digits_ = std::string_view(key);
+	} else if (size_) {
+	  auto [ ordinal, prefix_key ] = deconstruct(key, digits{});
+	  digits_[size_ - 1] = ordinal;
+	  for (size_t i = size_ - 1; i > 0; i--) {
+	    auto [ next_ordinal, next_prefix_key ] = deconstruct(std::move(prefix_key), digits{});
+	    digits_[i - 1] = next_ordinal;
+	    prefix_key = std::move(next_prefix_key);
+	  }
+	}
+      }
+
+      size_t operator[](size_t i) const noexcept {
+	if constexpr (is_string_key) return static_cast<uint8_t>(digits_[i]);
+	else return digits_[i];
+      }
+      size_t size() const noexcept { return size_; }
+
+    private:
+      size_t size_;
+      typename std::conditional<is_string_key, std::string_view, std::array<size_t, 8 * sizeof(key_type)>>::type digits_;
+    };
+
+    // shares_level returns true if the keys only differ by the last digit, so that their Nodes are in the same Level
+    static bool shares_level(const key_type & a, const key_type & b) noexcept {
+      auto n = keysize(a, digits{});
+      return n && n == keysize(b, digits{}) && deconstruct(make_lookup_key(a), digits{}).second == deconstruct(make_lookup_key(b), digits{}).second;
+    }
+    // make_sort_code packs the digits of a fixed size key into an integer, so that the first digit is the most significant
+    static uint64_t make_sort_code(const key_type & key) noexcept {
+      auto n = keysize(key, digits{});
+      auto [ ordinal, prefix_key ] = deconstruct(key, digits{});
+      uint64_t code = ordinal;
+      for (size_t i = 1; i < n; i++) {
+	auto [ next_ordinal, next_prefix_key ] = deconstruct(std::move(prefix_key), digits{});
+	code |= static_cast<uint64_t>(next_ordinal) << (DigitBits * i);
+	prefix_key = std::move(next_prefix_key);
+      }
+      return code;
+    }
+
+    // load_sorted sorts n values by key and bulk loads them. get(i) returns the value at position i of the input,
+    // which is moved from if it's an rvalue reference.
+    template <typename Get>
+    void load_sorted(size_t n, Get get) {
+      if (!n) return;
+      if constexpr (std::is_arithmetic<internal_key_type>::value) {
+	// the digits of fixed size keys are packed into a single integer that is radix sorted
+	const size_t fixed_keysize = keysize(key_type{}, digits{});
+	std::vector<std::pair<uint64_t, size_t>> codes;
+	codes.reserve(n);
+	for (size_t i = 0; i < n; i++) {
+	  codes.emplace_back(make_sort_code(getFirstConst(get(i))), i);
+	}
+	radix_sort(codes, (fixed_keysize * DigitBits + 7) / 8);
+	bulk_load(codes.size(),
+		  [&](size_t) { return fixed_keysize; },
+		  [&](size_t i, size_t depth) { return static_cast<size_t>((codes[i].first >> (DigitBits * (fixed_keysize - depth))) & digits::mask); },
+		  [&](size_t i, size_t j) {
+		    auto x = codes[i].first ^ codes[j].first;
+		    return x ? fixed_keysize - 1 - (63 - countl_zero(x)) / DigitBits : fixed_keysize;
+		  },
+		  [&](size_t i) -> decltype(auto) { return get(codes[i].second); });
+      } else {
+	std::vector<size_t> order(n);
+	for (size_t i = 0; i < order.size(); i++) order[i] = i;
+	// std::string compares characters as unsigned, which is the order of the digits
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+	  auto & key_a = getFirstConst(get(a)), & key_b = getFirstConst(get(b));
+	  return key_a < key_b || (key_a == key_b && a < b);
+	});
+	auto get_key = [&](size_t i) { return std::string_view(getFirstConst(get(order[i]))); };
+	bulk_load(order.size(),
+		  [&](size_t i) { return get_key(i).size(); },
+		  [&](size_t i, size_t depth) { return static_cast<size_t>(static_cast<uint8_t>(get_key(i)[depth - 1])); },
+		  [&](size_t i, size_t j) {
+		    auto a = get_key(i), b = get_key(j);
+		    return static_cast<size_t>(std::mismatch(a.begin(), a.end(), b.begin(), b.end()).first - a.begin());
+		  },
+		  [&](size_t i) -> decltype(auto) { return get(order[i]); });
+      }
+    }
+
+    // radix_sort sorts the codes by their lowest bytes with a stable LSD radix sort, so that equal keys stay in input order
+    static void radix_sort(std::vector<std::pair<uint64_t, size_t>> & codes, size_t bytes) {
+      std::vector<std::pair<uint64_t, size_t>> tmp(codes.size());
+      for (size_t d = 0; d < bytes; d++) {
+	size_t shift = 8 * d;
+	size_t counts[256] = { };
+	for (auto & c : codes) counts[(c.first >> shift) & 0xff]++;
+	if (counts[(codes.front().first >> shift) & 0xff] == codes.size()) continue; // all the keys share the digit
+	size_t pos = 0;
+	for (auto & c : counts) {
+	  auto n = c;
+	  c = pos;
+	  pos += n;
+	}
+	for (auto & c : codes) tmp[counts[(c.first >> shift) & 0xff]++] = c;
+	codes.swap(tmp);
+      }
+    }
+
+    // bulk_load builds the tree from n sorted keys. Each key only creates the Nodes that it doesn't share
+    // with the previous key, and the value counts of the shared Nodes are added when they leave the path.
+    // The part of a key that isn't shared with either neighbour is compressed into a head and a detached Node.
+    // key_size(i) returns the number of digits, digit(i, depth) the digit at depth (1 = most significant),
+    // common(i, j) the number of shared leading digits, and value(i) the value of the key at position i.
+    template <typename KeySize, typename Digit, typename Common, typename Value>
+    void bulk_load(size_t n, KeySize key_size, Digit digit, Common common, Value value) {
+      // first count the Nodes, so that the table can be sized exactly. The number of digits shared with
+      // the previous key is stored, since the previous value has been moved when the key is inserted.
+      std::vector<size_t> shared_digits(n), unique_from(n);
+      size_t num_nodes = 0, num_keys = 0, max_depth = 0;
+      for (size_t i = 0; i < n; i++) {
+	auto depth = key_size(i);
+	auto shared = i ? common(i - 1, i) : 0;
+	if (i && shared == depth && key_size(i - 1) == depth) {
+	  shared_digits[i] = duplicate_key;
+	  continue;
+	}
+	shared_digits[i] = shared;
+      }
+      // the digits after those shared with the next key are unique to the key
+      for (size_t i = n, next_shared = 0; i-- > 0; ) {
+	auto shared = shared_digits[i];
+	if (shared == duplicate_key) continue;
+	auto depth = key_size(i);
+	unique_from[i] = std::max(shared, next_shared);
+	if (depth - unique_from[i] >= 3) {
+	  num_nodes += unique_from[i] - shared + 2;
+	} else {
+	  num_nodes += depth ? depth - shared : 1;
+	}
+	num_keys++;
+	max_depth = std::max(max_depth, depth);
+	next_shared = shared;
+      }
+      reserve_nodes(num_nodes);
+      if constexpr (!inline_payload) arena_.reserve(num_keys);
+      levels_.reserve(levels_.size() + num_nodes - num_keys + 1); // at most the non-final Nodes have children
+
+      // the current path: the Node at each depth, the number of keys stored before it was created,
+      // and the prefix key, prefix hash and containing Level of its children
+      std::vector<Node *> path(max_depth + 1);
+      std::vector<size_t> first_key(max_depth + 1), prefix_hashes(max_depth + 1);
+      std::vector<internal_key_type> prefix_keys(max_depth + 1);
+      std::vector<uint32_t> levels(max_depth + 1);
+      levels[0] = root_level;
+
+      size_t path_depth = 0;
+      auto flush = [&](size_t depth) {
+	for (; path_depth > depth; path_depth--) {
+	  path[path_depth]->add_value_count(num_final_entries_ - first_key[path_depth] - 1);
+	}
+      };
+      
+      for (size_t i = 0; i < n; i++) {
+	auto shared = shared_digits[i];
+	if (shared == duplicate_key) continue;
+	auto depth = key_size(i);
+	flush(shared);
+
+	Node * node = nullptr, * head = nullptr;
+	if (!depth) {
+	  node = std::get<0>(create_node(0, internal_key_type{}, 0, 0));
+	}
+	auto last_depth = depth - unique_from[i] >= 3 ? unique_from[i] + 1 : depth;
+	for (size_t d = shared + 1; d <= last_depth; d++) {
+	  auto ordinal = digit(i, d);
+	  bool is_new;
+	  std::tie(node, std::ignore, std::ignore, is_new) = create_node(d, prefix_keys[d - 1], prefix_hashes[d - 1], ordinal);
+	  if (!is_new) node->inc_value_count();
+	  prefix_keys[d] = append(prefix_keys[d - 1], ordinal, digits{});
+	  prefix_hashes[d] = extend_prefix_hash(prefix_hashes[d - 1], ordinal);
+	  // mark the Node in the bitmap of the parent
+	  if (d == 1) {
+	    levels[1] = root_level;
+	  } else {
+	    auto parent = path[d - 1];
+	    if (!parent->get_children()) {
+	      auto level = alloc_level(parent);
+	      parent->set_children(level);
+	      levels_[level].set_parent(levels[d - 1]);
+	    }
+	    levels[d] = parent->get_children();
+	  }
+	  levels_[levels[d]].set(ordinal);
+	  node->set_parent(levels[d]);
+	  path[d] = node;
+	  first_key[d] = num_final_entries_;
+	}
+	path_depth = last_depth;
+	if (last_depth < depth) {
+	  // the final Node is created without the Nodes between it and the head
+	  head = node;
+	  head->set_head(true);
+	  auto prefix_key = prefix_keys[last_depth];
+	  auto prefix_hash = prefix_hashes[last_depth];
+	  for (size_t d = last_depth + 1; d < depth; d++) {
+	    auto ordinal = digit(i, d);
+	    prefix_key = append(std::move(prefix_key), ordinal, digits{});
+	    prefix_hash = extend_prefix_hash(prefix_hash, ordinal);
+	  }
+	  node = std::get<0>(create_node(depth, prefix_key, prefix_hash, digit(i, depth)));
+	  node->set_detached(true);
+	}
+
+	store_value(node, head, value(i));
+	num_final_entries_++;
+	num_inserts_++;
+      }
+      flush(0);
+    }
+
+    // find_impl finds the final Node for the key with a single probe sequence. The lookup
+    // key may be a view, so the returned iterator doesn't store the prefix key.
+    template <typename It, typename TablePtr, typename K>
+    static It find_impl(TablePtr table, const K & key) noexcept {
+      if (!table->table_size_ || !is_whole_digits(key, digits{})) return It(table);
+      auto [ ordinal, prefix_key ] = deconstruct(key, digits{});
+      auto depth = keysize(key, digits{});
+      auto prefix_hash = calc_prefix_hash(depth, prefix_key);
+      auto hash = calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal);
+      auto node = table->find_node(hash, depth, prefix_key, ordinal);
+      if (node && node->get_payload() && !node->is_head()) {
+	return It(table, node->get_payload(), depth, ordinal, table->get_offset(node, hash), prefix_hash, hash);
+      } else {
+	return It(table); // not found, not final, or the head of a longer key
+      }
+    }
+
+    // bound_impl finds the Node of the key, or else the deepest existing Node on its path. The search continues
+    // from the next digit of the key below that Node. A head on the path holds the only key below it, which is
+    // either the result or just before it. The key itself is skipped for the upper bound.
+    template <typename It, typename TablePtr, typename K>
+    static It bound_impl(TablePtr table, const K & key, bool upper) {
+      if constexpr (compact_nodes) return bound_compact<It>(table, std::string_view(key), upper);
+      check_digits(key);
+      if (!table->table_size_) return It(table);
+      auto [ ordinal, prefix_key ] = deconstruct(key, digits{});
+      auto depth = keysize(key, digits{});
+      auto prefix_hash = calc_prefix_hash(depth, prefix_key);
+      auto node = table->find_node(calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal), depth, prefix_key, ordinal);
+      internal_key_type node_prefix_key(prefix_key);
+      if (!node && depth) {
+	size_t child_ordinal = ordinal;
+	node = table->find_ancestor(depth, node_prefix_key, prefix_hash, ordinal, child_ordinal);
+	if (node && !node->is_head()) {
+	  node_prefix_key = append(std::move(node_prefix_key), ordinal, digits{});
+	  prefix_hash = extend_prefix_hash(prefix_hash, ordinal);
+	  ordinal = child_ordinal;
+	  depth++;
+	  node = nullptr;
+	}
+      }
+      auto hash = calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal);
+      auto payload = node ? node->get_payload() : nullptr;
+      It it(table, payload, depth, std::move(node_prefix_key), ordinal, node ? table->get_offset(node, hash) : 0, prefix_hash, hash);
+      if (!payload) {
+	it.fast_forward();
+      } else if (!node->is_head()) {
+	if (upper) it++; // the key itself
+      } else {
+	auto head_key = make_lookup_key(getFirstConst(*payload));
+	if (upper ? !(key < head_key) : head_key < key) it++;
+      }
+      return it;
+    }
+
+    // equal_range_impl doesn't advance the iterator of the key, since that would build its prefix key
+    template <typename It, typename TablePtr, typename K>
+    static std::pair<It, It> equal_range_impl(TablePtr table, const K & key) {
+      auto it = find_impl<It>(table, key);
+      auto next = bound_impl<It>(table, key, true);
+      return std::pair(it == It(table) ? next : it, next);
+    }
+
+    // bound_compact is bound_impl for string tables. The Node of the key, or its deepest ancestor, is found with
+    // views of the key, and the search continues from there with seek_compact, so that nothing is allocated.
+    template <typename It, typename TablePtr>
+    static It bound_compact(TablePtr table, std::string_view key, bool upper) {
+      if (!table->table_size_) return It(table);
+      auto [ ordinal, prefix_key ] = deconstruct(key, digits{});
+      auto depth = key.size();
+      auto prefix_hash = calc_prefix_hash(depth, prefix_key);
+      auto hash = calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal);
+      auto node = table->find_node(hash, depth, prefix_key, ordinal);
+      if (!depth) {
+	// the empty key precedes the Nodes of the first digit
+	if (node && node->get_payload() && !upper) return It(table, node->get_payload(), 0, 0, table->get_offset(node, hash), 0, hash);
+	return seek_compact<It>(table, 1, 0, root_level, 0);
+      }
+      if (node && node->get_payload() && !node->is_head()) {
+	if (!upper) return It(table, node->get_payload(), depth, ordinal, table->get_offset(node, hash), prefix_hash, hash);
+	if (node->is_detached()) {
+	  // the key is the only one below the head of its compressed path
+	  size_t child_ordinal = ordinal;
+	  node = table->find_ancestor(depth, prefix_key, prefix_hash, ordinal, child_ordinal);
+	  return seek_compact<It>(table, depth, prefix_hash, node->get_parent(), ordinal + 1);
+	}
+      } else if (!node) {
+	size_t child_ordinal = ordinal;
+	node = table->find_ancestor(depth, prefix_key, prefix_hash, ordinal, child_ordinal);
+	if (!node) return seek_compact<It>(table, 1, 0, root_level, ordinal);
+	if (!node->is_head() && node->get_children()) {
+	  // the keys below the ancestor, from the next digit of the key
+	  return seek_compact<It>(table, depth + 1, extend_prefix_hash(prefix_hash, ordinal), node->get_children(), child_ordinal);
+	}
+      }
+      if (node->is_head()) {
+	// a head holds the only key below it, which is either the result or just before it
+	auto payload = node->get_payload();
+	auto head_key = make_lookup_key(getFirstConst(*payload));
+	if (upper ? key < head_key : !(head_key < key)) return find_impl<It>(table, head_key);
+      } else if (node->get_children() && (upper || !node->get_payload())) {
+	return seek_compact<It>(table, depth + 1, extend_prefix_hash(prefix_hash, ordinal), node->get_children(), 0);
+      }
+      return seek_compact<It>(table, depth, prefix_hash, node->get_parent(), ordinal + 1);
+    }
+
+    // seek_compact returns the first key at or after a position in a string table. Compact Nodes are matched by
+    // their Level, so the position only needs the depth, the prefix hash and the Level, and the prefix key isn't
+    // built. The iterator restores it from the payload when needed, as after find().
+    template <typename It, typename TablePtr>
+    static It seek_compact(TablePtr table, size_t depth, size_t prefix_hash, uint32_t level, size_t ordinal) {
+      while ( 1 ) {
+	auto o = table->levels_[level].next(ordinal);
+	if (o == bucket_count) {
+	  // we have run through the Level => go down the tree
+	  if (depth <= 1) return It(table);
+	  auto owner = table->levels_[level].get_owner();
+	  ordinal = owner->get_ordinal() + 1;
+	  prefix_hash = truncate_prefix_hash(prefix_hash, owner->get_ordinal());
+	  level = table->levels_[level].get_parent();
+	  depth--;
+	  continue;
+	}
+	auto hash = calc_final_hash(calc_unordered_hash(depth, prefix_hash), o);
+	auto node = table->find_node(hash, depth, std::string_view(), o, level);
+	if (node && node->get_payload()) {
+	  auto payload = node->get_payload();
+	  if (node->is_head()) return find_impl<It>(table, make_lookup_key(getFirstConst(*payload)));
+	  It it(table, payload, depth, o, table->get_offset(node, hash), prefix_hash, hash);
+	  it.set_level(level);
+	  return it;
+	} else if (node && node->get_children()) {
+	  // non-final Node => go up the tree
+	  level = node->get_children();
+	  prefix_hash = extend_prefix_hash(prefix_hash, o);
+	  depth++;
+	  ordinal = 0;
+	} else {
+	  ordinal = o + 1; // the bitmap is out of sync
+	}
+      }
+    }
+
+    template <typename It, typename TablePtr, typename K>
+    static BasicRange<std::is_same<It, const_iterator>::value> range_impl(TablePtr table, const K & first, const K & last) {
+      auto it = bound_impl<It>(table, first, false);
+      if (!(first < last)) return { it, it };
+      return { it, bound_impl<It>(table, last, false) };
+    }
+
+    // prefix_range_impl positions the first iterator at the Node of the prefix, and the last one after it. If the
+    // Node doesn't exist, a key starting with the prefix can only be the key of a head above it.
+    template <typename It, typename TablePtr>
+    static BasicRange<std::is_same<It, const_iterator>::value> prefix_range_impl(TablePtr table, std::string_view prefix) {
+      if (prefix.empty()) {
+	It it(table);
+	if (table->size()) it.fast_forward();
+	return { it, It(table) };
+      }
+      if (!table->table_size_) return { It(table), It(table) };
+      auto [ ordinal, prefix_key ] = deconstruct(prefix, digits{});
+      auto depth = prefix.size();
+      auto prefix_hash = calc_prefix_hash(depth, prefix_key);
+      auto hash = calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal);
+      auto node = table->find_node(hash, depth, prefix_key, ordinal);
+      if (!node) {
+	auto it = bound_impl<It>(table, prefix, false);
+	if (it == It(table) || std::string_view(getFirstConst(*it)).substr(0, prefix.size()) != prefix) return { it, it };
+	return { it, bound_impl<It>(table, std::string_view(getFirstConst(*it)), true) };
+      }
+      auto first = bound_impl<It>(table, prefix, false);
+      if (node->is_detached()) return { first, bound_impl<It>(table, prefix, true) }; // the final Node of a compressed path
+      return { first, seek_compact<It>(table, depth, prefix_hash, node->get_parent(), ordinal + 1) };
+    }
+
+    size_t count_prefix_impl(std::string_view prefix) const {
+      if (prefix.empty()) return num_final_entries_;
+      if (!table_size_) return 0;
+      auto [ ordinal, prefix_key ] = deconstruct(prefix, digits{});
+      auto depth = prefix.size();
+      auto prefix_hash = calc_prefix_hash(depth, prefix_key);
+      if (auto node = find_node(calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal), depth, prefix_key, ordinal)) {
+	return node->get_value_count();
+      }
+      size_t child_ordinal = ordinal;
+      auto node = find_ancestor(depth, prefix_key, prefix_hash, ordinal, child_ordinal);
+      if (!node || !node->is_head()) return 0;
+      return std::string_view(getFirstConst(*node->get_payload())).substr(0, prefix.size()) == prefix ? 1 : 0;
+    }
+
+    // longest_prefix_match_impl starts from the final Node of the key, or the deepest existing Node on its path
+    template <typename It, typename TablePtr, typename K>
+    static It longest_prefix_match_impl(TablePtr table, const K & key) {
+      check_digits(key);
+      if (!table->table_size_) return It(table);
+      auto [ ordinal, prefix_key ] = deconstruct(key, digits{});
+      auto depth = keysize(key, digits{});
+      auto prefix_hash = calc_prefix_hash(depth, prefix_key);
+      auto node = table->find_node(calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal), depth, prefix_key, ordinal);
+      if (!node && depth) {
+	if constexpr (is_string_key) {
+	  size_t child_ordinal = ordinal;
+	  node = table->find_ancestor(depth, prefix_key, prefix_hash, ordinal, child_ordinal);
+	} else {
+	  BoundedPath path;
+	  table->init_path(path, depth, prefix_key, prefix_hash, ordinal);
+	  while (!path.done()) table->bisect_step(path);
+	  node = path.found;
+	  depth = std::max(path.lo, size_t(1));
+	  prefix_key = path.prefix_keys[depth];
+	  prefix_hash = path.prefix_hashes[depth];
+	  ordinal = path.ordinals[depth];
+	}
+      }
+      return find_match<It>(table, key, node, depth, std::move(prefix_key), prefix_hash, ordinal);
+    }
+
+    // longest_prefix_match_range splits a forward range into groups of at most lookup_batch_size keys
+    template <typename It, typename TablePtr, typename ForwardIt, typename OutputIt>
+    static OutputIt longest_prefix_match_range(TablePtr table, ForwardIt first, ForwardIt last, OutputIt out) {
+      while (first != last) {
+	auto group = first;
+	size_t n = 0;
+	if constexpr (is_string_key) {
+	  for (; first != last && n < lookup_batch_size; ++first, n++) table->prefetch_final_node(make_lookup_key(*first));
+	  for (; n; n--, ++group) *out++ = longest_prefix_match_impl<It>(table, make_lookup_key(*group));
+	} else {
+	  for (; first != last && n < lookup_batch_size; ++first) n++;
+	  out = longest_prefix_match_batch<It>(table, group, n, out);
+	}
+      }
+      return out;
+    }
+
+    // longest_prefix_match_batch looks up a group of keys of bounded size. The final Nodes are probed first, and
+    // then the binary searches for the deepest existing Nodes advance together, so that the Nodes probed by one
+    // step are prefetched for all the keys before any of them is probed.
+    template <typename It, typename TablePtr, typename ForwardIt, typename OutputIt>
+    static OutputIt longest_prefix_match_batch(TablePtr table, ForwardIt first, size_t n, OutputIt out) {
+      std::array<BoundedPath, lookup_batch_size> paths;
+      auto it = first;
+      for (size_t i = 0; i < n; i++, ++it) {
+	const key_type & key = *it;
+	check_digits(key);
+	auto [ ordinal, prefix_key ] = deconstruct(key, digits{});
+	auto depth = keysize(key, digits{});
+	table->init_path(paths[i], depth, prefix_key, calc_prefix_hash(depth, prefix_key), ordinal);
+	table->prefetch_node(table->get_path_hash(paths[i], depth));
+      }
+      for (auto & path : paths) {
+	if (path.hi) {
+	  auto d = path.hi;
+	  path.found = table->find_node(table->get_path_hash(path, d), d, path.prefix_keys[d], path.ordinals[d]);
+	  if (path.found) path.lo = d; // the search is over
+	}
+      }
+      for (bool active = true; active; ) {
+	active = false;
+	for (size_t i = 0; i < n; i++) {
+	  if (!paths[i].done()) table->prefetch_node(table->get_path_hash(paths[i], paths[i].mid()));
+	}
+	for (size_t i = 0; i < n; i++) {
+	  if (!paths[i].done()) {
+	    table->bisect_step(paths[i]);
+	    active = true;
+	  }
+	}
+      }
+      for (size_t i = 0; i < n; i++, ++first) {
+	auto & path = paths[i];
+	auto depth = path.found ? path.lo : std::min(path.hi, size_t(1));
+	*out++ = find_match<It>(table, static_cast<const key_type &>(*first), path.found, depth, path.prefix_keys[depth], path.prefix_hashes[depth], path.ordinals[depth]);
+      }
+      return out;
+    }
+
+    // find_match returns the longest key that is a prefix of the key, given the deepest existing Node on its path
+    // and its position. A head holds the only key below it, which is compared with the key. Otherwise the result
+    // is the first Node with a key of its own on the way to the root, and the empty key is the last candidate.
+    template <typename It, typename TablePtr, typename K, typename P>
+    static It find_match(TablePtr table, const K & key, Node * node, size_t depth, P prefix_key, size_t prefix_hash, size_t ordinal) {
+      if (node && node->is_head() && is_prefix(make_lookup_key(getFirstConst(*node->get_payload())), key)) {
+	auto hash = calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal);
+	return It(table, node->get_payload(), depth, internal_key_type(prefix_key), ordinal, table->get_offset(node, hash), prefix_hash, hash);
+      }
+      while (node && depth) {
+	if (node->get_payload() && !node->is_head()) {
+	  auto hash = calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal);
+	  return It(table, node->get_payload(), depth, ordinal, table->get_offset(node, hash), prefix_hash, hash);
+	}
+	if (depth == 1) break;
+	// the parent owns the Level containing the Node, which is known for compact Nodes and Nodes with children
+	uint32_t level = no_level;
+	if constexpr (compact_nodes) {
+	  level = node->get_parent();
+	} else if (node->get_children()) {
+	  level = table->levels_[node->get_children()].get_parent();
+	}
+	auto [ parent_ordinal, parent_prefix_key ] = deconstruct(std::move(prefix_key), digits{});
+	ordinal = parent_ordinal;
+	prefix_key = std::move(parent_prefix_key);
+	prefix_hash = truncate_prefix_hash(prefix_hash, ordinal);
+	depth--;
+	node = level != no_level ? table->levels_[level].get_owner() : table->find_node(calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal), depth, prefix_key, ordinal);
+      }
+      auto empty = table->find_empty_key();
+      return empty ? find_impl<It>(table, make_lookup_key(getFirstConst(*empty->get_payload()))) : It(table);
+    }
+
+    // prefetch_final_node loads the first slot probed for the final Node of the key into the cache
+    template <typename K>
+    void prefetch_final_node(const K & key) const noexcept {
+      auto [ ordinal, prefix_key ] = deconstruct(key, digits{});
+      auto depth = keysize(key, digits{});
+      prefetch_node(calc_final_hash(calc_unordered_hash(depth, calc_prefix_hash(depth, prefix_key)), ordinal));
+    }
+
+    // prefetch_node loads the first slot probed for the hash into the cache
+    void prefetch_node(size_t hash) const noexcept {
+      if (!table_size_) return;
+#if defined(__GNUC__) || defined(__clang__)
+      __builtin_prefetch(nodes_ + (hash & table_mask_));
+#elif defined(RADIX_CPP_AVX2) || defined(RADIX_CPP_SSE2)
+      _mm_prefetch(reinterpret_cast<const char *>(nodes_ + (hash & table_mask_)), _MM_HINT_T0);
+#endif
+    }
+
+    template <typename It, typename TablePtr, typename F>
+    static void for_each_unordered_impl(TablePtr table, F & f) {
+      if constexpr (!inline_payload) {
+	// the Arena of a loaded table is empty
+	if (!table->arena_.has_free_slots() && table->arena_.size() == table->size()) {
+	  table->arena_.for_each([&](value_type & value) { f(static_cast<typename It::reference>(value)); });
+	  return;
+	}
+      }
+      for (auto nodes : { std::pair(table->top_, direct_top && table->top_ ? bucket_count : 0),
+			  std::pair(table->nodes_, table->table_size_),
+			  std::pair(table->old_nodes_, table->old_nodes_ ? table->old_mask_ + 1 : 0) }) {
+	for (auto node = nodes.first, end = nodes.first + nodes.second; node != end; node++) {
+	  if (node->is_assigned() && node->get_payload() && !node->is_head()) f(static_cast<typename It::reference>(*node->get_payload()));
+	}
+      }
+    }
+
+    // find_empty_key returns the Node of the empty key, which precedes the Nodes of the first digit
+    const Node * find_empty_key() const noexcept {
+      if constexpr (!std::is_arithmetic<internal_key_type>::value) {
+	auto node = table_size_ ? find_node(calc_final_hash(calc_unordered_hash(0, 0), 0), 0, internal_key_type{}, 0) : nullptr;
+	return node && node->get_payload() ? node : nullptr;
+      } else {
+	return nullptr;
+      }
+    }
+
+    // get_level_total returns the number of keys below the Nodes of the Level. The owner of the Level counts
+    // them, and its own key if it has one.
+    size_t get_level_total(uint32_t level) const noexcept {
+      if (level == root_level) return num_final_entries_ - (find_empty_key() ? 1 : 0);
+      auto owner = levels_[level].get_owner();
+      return owner->get_value_count() - (owner->get_payload() ? 1 : 0);
+    }
+
+    // count_below returns the number of keys below the Nodes of the Level whose ordinals are less than ordinal.
+    // The Nodes on the shorter side of the ordinal are visited, and those on the other side are subtracted
+    // from the total of the Level.
+    template <typename K>
+    size_t count_below(uint32_t level, size_t depth, const K & prefix_key, size_t prefix_hash, size_t ordinal) const noexcept {
+      auto & l = levels_[level];
+      auto hash0 = calc_unordered_hash(depth, prefix_hash);
+      auto sum = [&](size_t first, size_t last) {
+	size_t n = 0;
+	for (auto o = l.next(first); o < last; o = l.next(o + 1)) {
+	  if (auto node = find_node(calc_final_hash(hash0, o), depth, prefix_key, o, level)) n += node->get_value_count();
+	}
+	return n;
+      };
+      auto below = l.count_below(ordinal);
+      if (below <= l.count() - below) return sum(0, ordinal);
+      return get_level_total(level) - sum(ordinal, bucket_count);
+    }
+
+    // rank_impl follows the path of the key from the root, and counts the keys that precede it at each depth:
+    // those below the smaller siblings, and the key of the Node itself. The path ends at a missing Node, at
+    // the final Node, or at a head, whose only key is compared with the key.
+    template <typename K>
+    size_t rank_impl(const K & key) const {
+      check_digits(key);
+      if (!table_size_) return 0;
+      auto n = keysize(key, digits{});
+      size_t r = 0;
+      uint64_t code = 0;
+      if constexpr (std::is_arithmetic<internal_key_type>::value) {
+	code = make_sort_code(key);
+      } else if (n && find_empty_key()) {
+	r++;
+      }
+      KeyDigits key_digits(key);
+      internal_key_type prefix_key{};
+      size_t prefix_hash = 0;
+      uint32_t level = root_level;
+      for (size_t depth = 1; depth <= n; depth++) {
+	auto ordinal = key_digits[depth - 1];
+	r += count_below(level, depth, prefix_key, prefix_hash, ordinal);
+	auto node = find_node(calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal), depth, prefix_key, ordinal, level);
+	if (!node || depth == n) break;
+	if (node->is_head()) {
+	  auto & head_key = getFirstConst(*node->get_payload());
+	  if constexpr (std::is_arithmetic<internal_key_type>::value) {
+	    if (make_sort_code(head_key) < code) r++;
+	  } else {
+	    if (make_lookup_key(head_key) < key) r++;
+	  }
+	  break;
+	}
+	if (node->get_payload()) r++; // the key of the Node is a prefix of the key
+	level = node->get_children();
+	if (!level) break;
+	prefix_key = append(std::move(prefix_key), ordinal, digits{});
+	prefix_hash = extend_prefix_hash(prefix_hash, ordinal);
+      }
+      return r;
+    }
+
+    // find_nth returns the payload of the key at position k, by descending into the Node whose keys include
+    // position k at each depth
+    const value_type * find_nth(size_t k) const {
+      if (k >= num_final_entries_) return nullptr;
+      if (auto node = find_empty_key()) {
+	if (k == 0) return node->get_payload();
+	k--;
+      }
+      internal_key_type prefix_key{};
+      size_t prefix_hash = 0;
+      uint32_t level = root_level;
+      for (size_t depth = 1; ; depth++) {
+	auto & l = levels_[level];
+	auto hash0 = calc_unordered_hash(depth, prefix_hash);
+	const Node * node = nullptr;
+	size_t ordinal = l.next(0);
+	for (; ordinal < bucket_count; ordinal = l.next(ordinal + 1)) {
+	  node = find_node(calc_final_hash(hash0, ordinal), depth, prefix_key, ordinal, level);
+	  if (!node) continue;
+	  auto c = node->get_value_count();
+	  if (k < c) break;
+	  k -= c;
+	}
+	if (ordinal == bucket_count) return nullptr; // the counts are out of sync
+	if (node->get_payload()) {
+	  if (k == 0 || node->is_head()) return node->get_payload();
+	  k--;
+	}
+	level = node->get_children();
+	if (!level) return nullptr;
+	prefix_key = append(std::move(prefix_key), ordinal, digits{});
+	prefix_hash = extend_prefix_hash(prefix_hash, ordinal);
+      }
+    }
+
+    // find_last returns the payload of the last key, by descending into the Node with the largest ordinal at each
+    // depth. A Node without children is final, or the head of a compressed path.
+    const value_type * find_last() const {
+      if (!num_final_entries_) return nullptr;
+      const Node * parent = find_empty_key(); // the key of the parent precedes its children
+      internal_key_type prefix_key{};
+      size_t prefix_hash = 0;
+      uint32_t level = root_level;
+      for (size_t depth = 1; ; depth++) {
+	auto ordinal = levels_[level].prev(bucket_count - 1);
+	if (ordinal == bucket_count) return parent ? parent->get_payload() : nullptr;
+	auto node = find_node(calc_final_hash(calc_unordered_hash(depth, prefix_hash), ordinal), depth, prefix_key, ordinal, level);
+	if (!node) return nullptr; // the bitmap is out of sync
+	level = node->get_children();
+	if (!level) return node->get_payload();
+	parent = node;
+	prefix_key = append(std::move(prefix_key), ordinal, digits{});
+	prefix_hash = extend_prefix_hash(prefix_hash, ordinal);
+      }
+    }
+
+    // make_lookup_key returns a view of a string key, so that decomposing it doesn't copy
+    static auto make_lookup_key(const key_type & key) noexcept {
+      if constexpr (is_string_key) {
+	return std::string_view(key);
+      } else {
+	return key;
+      }
+    }
+
     // getFirstConst returns the key from value_type for either set or map
     // This version is for sets, where value_type == key_type
     static key_type const& getFirstConst(key_type const& k) noexcept {
@@ -988,93 +3665,655 @@ namespace radix_cpp {
 
     // size must be a power of two
     void init(size_t s) {
-      if (nodes_) std::free(nodes_);
-      table_size_ = inserts_remaining_ = s;
+      free_nodes(nodes_, table_size_);
+      table_size_ = s;
       table_mask_ = s - 1;
+      num_tombstones_ = 0;
       nodes_ = alloc_nodes(s);
+      if (direct_top && !top_) top_ = alloc_nodes(bucket_count);
+      inserts_remaining_ = get_inserts_until_rehash();
+      levels_.clear();
+      free_levels_.clear();
+      levels_.emplace_back().reset(no_level, nullptr); // root_level
+    }
+
+    // release_node decrements the value count of the Node, and removes it if it becomes empty
+    bool release_node(Node * node) noexcept {
+      if (node->dec_value_count()) {
+	node->clear_prefix_key();
+	if (node >= nodes_ && node < nodes_ + table_size_) {
+	  set_ctrl(nodes_, table_mask_, static_cast<size_t>(node - nodes_), ctrl_tombstone);
+	  num_tombstones_++;
+	} else if (old_nodes_ && node >= old_nodes_ && node <= old_nodes_ + old_mask_) {
+	  set_ctrl(old_nodes_, old_mask_, static_cast<size_t>(node - old_nodes_), ctrl_tombstone);
+	}
+	if (!is_top_node(node)) {
+	  num_entries_--;
+	  inserts_remaining_++;
+	}
+	return true;
+      } else {
+	return false;
+      }
     }
 
-    static Node * alloc_nodes(size_t s) {
-      auto nodes = reinterpret_cast<Node*>(std::malloc(s * sizeof(Node)));
-      if (!nodes) throw std::bad_alloc();
+    // inc_ancestors increments the value counts of the owner of the Level and all its ancestors
+    void inc_ancestors(uint32_t level) noexcept {
+      for (; level != root_level; level = levels_[level].get_parent()) {
+	levels_[level].get_owner()->inc_value_count();
+      }
+    }
+
+    uint32_t alloc_level(Node * owner) {
+      uint32_t idx;
+      if (!free_levels_.empty()) {
+	idx = free_levels_.back();
+	free_levels_.pop_back();
+      } else {
+	idx = static_cast<uint32_t>(levels_.size());
+	levels_.emplace_back();
+      }
+      levels_[idx].reset(no_level, owner);
+      return idx;
+    }
+
+    void free_level(uint32_t idx) {
+      free_levels_.push_back(idx);
+    }
+
+    // find_level returns the Level of the nodes with given depth and prefix, or no_level
+    // if the parent Node does not exist or has no children
+    uint32_t find_level(size_t depth, const internal_key_type & prefix_key, size_t prefix_hash) const noexcept {
+      if (depth <= 1) return root_level;
+      auto [ ordinal, parent_prefix_key ] = deconstruct(prefix_key, digits{});
+      auto parent_prefix_hash = truncate_prefix_hash(prefix_hash, ordinal);
+      auto hash = calc_final_hash(calc_unordered_hash(depth - 1, parent_prefix_hash), ordinal);
+      auto node = find_node(hash, depth - 1, parent_prefix_key, ordinal);
+      if (node && node->get_children()) {
+	return node->get_children();
+      } else {
+	return no_level;
+      }
+    }
+
+    // destroy_nodes destroys the assigned Nodes and their payloads, and frees the array
+    void destroy_nodes(Node * nodes, size_t s) noexcept {
       for (size_t i = 0; i < s; i++) {
-	nodes[i].reset();
+	auto & node = nodes[i];
+	if (node.is_assigned()) {
+	  node.clear_prefix_key();
+	  if (node.get_payload() && !node.is_head()) { // the final Node of a compressed path owns the payload
+	    node.get_payload()->~value_type();
+	  }
+	}
+      }
+      free_nodes(nodes, s);
+    }
+
+    // the nodes are zero-initialized (unassigned). With std::allocator the array is allocated with calloc,
+    // so that large arrays are cleared lazily by the OS, and other allocators can declare that they zero-fill. The control bytes follow the nodes, and the first
+    // group of them is repeated at the end, so that a group starting at any slot can be loaded without
+    // wrapping around.
+    Node * alloc_nodes(size_t s) {
+      size_t bytes = s * sizeof(Node) + s + ControlGroup::width - 1;
+      if constexpr (is_std_allocator<Allocator>::value) {
+	auto nodes = reinterpret_cast<Node*>(std::calloc(1, bytes));
+	if (!nodes) throw std::bad_alloc();
+	return nodes;
+      } else {
+	auto nodes = std::allocator_traits<rebind_alloc<Node>>::allocate(node_alloc_, get_node_array_length(s));
+	if constexpr (!zeroes_memory<rebind_alloc<Node>>::value) std::memset(static_cast<void*>(nodes), 0, bytes);
+	return nodes;
+      }
+    }
+
+    // free_nodes frees a node array of size s (or null) without destroying the Nodes
+    void free_nodes(Node * nodes, size_t s) noexcept {
+      if constexpr (is_std_allocator<Allocator>::value) {
+	std::free(nodes);
+      } else if (nodes) {
+	std::allocator_traits<rebind_alloc<Node>>::deallocate(node_alloc_, nodes, get_node_array_length(s));
+      }
+    }
+
+    // FileHeader starts a saved table. The fields before base must match the loading table exactly.
+    struct FileHeader {
+      char magic[8];
+      uint64_t version, digit_bits, node_size, level_size, value_size, flags, hash_check;
+      uint64_t base;
+      uint64_t table_size, num_entries, num_final_entries, num_tombstones, num_levels, num_payloads;
+      uint64_t nodes_offset, top_offset, levels_offset, payloads_offset, file_size;
+    };
+
+    static FileHeader make_file_header() noexcept {
+      FileHeader h = { };
+      std::memcpy(h.magic, "RADIXCPP", sizeof(h.magic));
+      h.version = 1;
+      h.digit_bits = DigitBits;
+      h.node_size = sizeof(Node);
+      h.level_size = sizeof(Level);
+      h.value_size = sizeof(value_type);
+      h.flags = (is_map ? 1 : 0) | (inline_payload ? 2 : 0) | (direct_top ? 4 : 0);
+      h.hash_check = calc_final_hash(calc_unordered_hash(3, 0x12345), 5);
+      return h;
+    }
+
+    static constexpr uint64_t file_page_size = 4096;
+    static uint64_t align_to_page(uint64_t offset) noexcept { return (offset + file_page_size - 1) & ~(file_page_size - 1); }
+
+    // save picks the base address of a file from [map_base_begin, map_base_end), in steps of at least map_base_step
+    static constexpr uint64_t map_base_begin = UINT64_C(0x100000000000), map_base_end = UINT64_C(0x600000000000);
+    static constexpr uint64_t map_base_step = UINT64_C(1) << 32;
+
+    // pick_map_base returns a random base address for a file of the given size, or zero on 32-bit systems,
+    // where the file is mapped wherever there's room
+    static uintptr_t pick_map_base(const std::string & path, uint64_t file_size) noexcept {
+      if constexpr (sizeof(void*) < 8) {
+	return 0;
+      } else {
+	auto step = std::max(map_base_step, (file_size + map_base_step - 1) / map_base_step * map_base_step);
+	auto slots = (map_base_end - map_base_begin) / step;
+	if (!slots) return 0;
+	auto seed = static_cast<uint64_t>(std::hash<std::string>()(path)) ^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+	return static_cast<uintptr_t>(map_base_begin + murmur3_fmix(seed) % slots * step);
+      }
+    }
+
+    // is_valid_layout checks that the sections of a saved table are page aligned and lie within the file, so that
+    // a damaged header can't make the loaded table read outside the mapping
+    static bool is_valid_layout(const FileHeader & h) noexcept {
+      auto fits = [&](uint64_t offset, uint64_t n, uint64_t size) {
+	return offset % file_page_size == 0 && offset <= h.file_size && n <= (h.file_size - offset) / size;
+      };
+      if (h.table_size & (h.table_size - 1)) return false;
+      if (!fits(h.nodes_offset, h.table_size, sizeof(Node))) return false; // before the array length can overflow
+      return (!h.table_size || fits(h.nodes_offset, get_node_array_length(h.table_size), sizeof(Node))) &&
+	(!h.table_size || !direct_top || fits(h.top_offset, bucket_count, sizeof(Node))) &&
+	fits(h.levels_offset, h.num_levels, sizeof(Level)) &&
+	fits(h.payloads_offset, h.num_payloads, sizeof(value_type));
+    }
+
+    // check_digits throws if the key doesn't split into whole digits, since it would be stored as a shorter key
+    template <typename K>
+    static void check_digits(const K & key) {
+      if (!is_whole_digits(key, digits{})) throw std::invalid_argument("radix_cpp: the length of a bit prefix must be a multiple of the digit width");
+    }
+
+    void check_writable() const {
+      if (mapping_) throw std::logic_error("radix_cpp: the table is mapped read-only");
+    }
+
+#ifdef __linux__
+    // relocate adds delta to the payload pointers and the Level owners of a table mapped away from its base, and
+    // checks that they point to the sections of the file, and that the Level indices are valid. Since every page
+    // is written anyway, the checks don't add page faults.
+    void relocate(uintptr_t delta, const FileHeader & h) {
+      auto base = reinterpret_cast<uintptr_t>(mapping_);
+      auto invalid = [](const char * what) { return std::runtime_error(std::string("radix_cpp: invalid ") + what + " in a loaded table"); };
+      auto in_section = [&](uintptr_t address, uint64_t offset, uint64_t n, size_t size) {
+	return address >= base + offset && address < base + offset + n * size && (address - base - offset) % size == 0;
+      };
+      auto check_level = [&](uint32_t level) {
+	if (level != no_level && level >= h.num_levels) throw invalid("Level index");
+      };
+      auto relocate_nodes = [&](Node * nodes, size_t n) {
+	for (size_t i = 0; i < n; i++) {
+	  if (!nodes[i].is_assigned()) continue;
+	  check_level(nodes[i].get_children());
+	  if constexpr (!inline_payload) {
+	    if (auto payload = nodes[i].get_payload()) {
+	      auto address = reinterpret_cast<uintptr_t>(payload) + delta;
+	      if (!in_section(address, h.payloads_offset, h.num_payloads, sizeof(value_type))) throw invalid("payload pointer");
+	      nodes[i].set_payload(reinterpret_cast<value_type *>(address));
+	    }
+	  }
+	}
+      };
+      if (nodes_) relocate_nodes(nodes_, table_size_);
+      if (top_) relocate_nodes(top_, bucket_count);
+      for (size_t i = 0; i < levels_.size(); i++) {
+	check_level(levels_[i].get_parent());
+	if (auto owner = levels_[i].get_owner()) {
+	  auto address = reinterpret_cast<uintptr_t>(owner) + delta;
+	  if (!in_section(address, h.nodes_offset, h.table_size, sizeof(Node)) &&
+	      !(top_ && in_section(address, h.top_offset, bucket_count, sizeof(Node)))) throw invalid("Level owner");
+	  levels_[i].set_owner(reinterpret_cast<Node *>(address));
+	}
+      }
+    }
+#endif
+
+    // unmap_file releases the mapping of a loaded table, whose arrays are not owned by the allocators
+    void unmap_file() noexcept {
+#ifdef __linux__
+      ::munmap(mapping_, mapping_size_);
+#endif
+      mapping_ = nullptr;
+      mapping_size_ = 0;
+      nodes_ = top_ = nullptr;
+      table_size_ = table_mask_ = 0;
+      levels_.clear();
+    }
+
+    // returns the length of a node array of size s in Nodes, including the control bytes
+    static size_t get_node_array_length(size_t s) noexcept {
+      return s + (s + ControlGroup::width - 1 + sizeof(Node) - 1) / sizeof(Node);
+    }
+
+    static uint8_t * get_ctrl(Node * nodes, size_t s) noexcept { return reinterpret_cast<uint8_t*>(nodes + s); }
+    static const uint8_t * get_ctrl(const Node * nodes, size_t s) noexcept { return reinterpret_cast<const uint8_t*>(nodes + s); }
+
+    // set_ctrl sets the control byte of a slot, and its copies at the end of the array
+    static void set_ctrl(Node * nodes, size_t mask, size_t i, uint8_t c) noexcept {
+      auto ctrl = get_ctrl(nodes, mask + 1);
+      for (; i < mask + ControlGroup::width; i += mask + 1) ctrl[i] = c;
+    }
+
+    // get_tag returns the control byte of an assigned Node with the hash. The low bits of the hash select
+    // the slot, so the tag is taken from the high bits.
+    static uint8_t get_tag(size_t hash) noexcept {
+      return static_cast<uint8_t>(0x80 | (hash >> (8 * sizeof(size_t) - 7)));
+    }
+
+    // find_free_slot returns the first empty slot or tombstone in the probe chain of the hash
+    static size_t find_free_slot(const Node * nodes, size_t mask, size_t hash) noexcept {
+      auto ctrl = get_ctrl(nodes, mask + 1);
+      for (size_t offset = 0; ; offset += ControlGroup::width) {
+	if (auto m = ControlGroup(ctrl + ((hash + offset) & mask)).match_free()) {
+	  return (hash + offset + ControlGroup::index(m)) & mask;
+	}
       }
-      return nodes;
     }
     
-    void resize(size_t new_size) {
+    void resize(size_t new_size, size_t threads = 1) {
+      if (old_nodes_) migrate(old_mask_ + 1); // finish the previous resize
       auto new_mask = new_size - 1;
       auto new_nodes = alloc_nodes(new_size);
-      auto new_nodes_end = new_nodes + new_size;
-      
-      auto node = nodes_;
-      auto end = nodes_ + table_size_;
-      for (; node != end; node++) {
-	if (node->is_assigned()) {
-	  // get the least significant byte of depth from node, and the other bytes from the prefix key	  
-	  size_t depth = ((keysize(node->get_prefix_key()) + 1) & ~UINT64_C(0xff)) | node->get_depth_lsb();
-	  auto hash0 = calc_unordered_hash(depth, node->get_prefix_key());
-	  auto hash = calc_final_hash(hash0, node->get_ordinal());
-	  auto new_node = new_nodes + (hash & new_mask);
-
-	  while ( 1 ) {
-	    if (new_node->is_assigned()) {
-	      if (++new_node == new_nodes_end) new_node = new_nodes;
-	      num_insert_collisions_++;
-	    } else {
-	      new (static_cast<void*>(new_node)) Node(std::move(*node));
-	      node->~Node();
-	      break;
-	    }
+      threads = std::min(threads, table_size_ / parallel_rehash_min_nodes);
+
+      if (threads > 1) {
+	move_nodes_parallel(new_nodes, new_mask, threads);
+	free_nodes(nodes_, table_size_);
+      } else if (incremental_resize_ && num_entries_) {
+	// keep the old array, and move the Nodes a few at a time
+	old_nodes_ = nodes_;
+	old_mask_ = table_mask_;
+	migrate_pos_ = 0;
+      } else {
+	auto node = nodes_;
+	auto end = nodes_ + table_size_;
+	for (; node != end; node++) {
+	  if (node->is_assigned()) {
+	    move_node(node, new_nodes, new_mask);
 	  }
 	}
+	free_nodes(nodes_, table_size_);
       }
       
-      std::free(nodes_);
       nodes_ = new_nodes;
       table_size_ = new_size;
       table_mask_ = new_mask;
       inserts_remaining_ = get_inserts_until_rehash();
+      num_tombstones_ = 0;
+      num_resizes_++;
+    }
+
+    // purge_tombstones empties the tombstones of the node array in place, and moves the Nodes after them back
+    // towards their home slots. The array is walked from an empty slot, since no probe chain crosses one. Each
+    // Node goes to the first empty slot between its home slot and itself, if there is one, which only fills the
+    // chains of the Nodes already walked, so they stay intact.
+    void purge_tombstones() {
+      auto ctrl = get_ctrl(nodes_, table_size_);
+      auto start = static_cast<size_t>(std::find(ctrl, ctrl + table_size_, ctrl_empty) - ctrl);
+      if (start == table_size_) {
+	resize(table_size_); // every slot is taken, so the Nodes are rehashed to a new array
+	return;
+      }
+      for (size_t i = 0; i < table_size_; i++) {
+	if (ctrl[i] == ctrl_tombstone) {
+	  nodes_[i].reset();
+	  set_ctrl(nodes_, table_mask_, i, ctrl_empty);
+	}
+      }
+      for (size_t k = 1; k < table_size_; k++) {
+	auto i = (start + k) & table_mask_;
+	auto node = nodes_ + i;
+	if (!node->is_assigned()) continue;
+	auto hash = rehash_node(node);
+	auto target = find_free_slot(nodes_, table_mask_, hash);
+	if (((target - hash) & table_mask_) > ((i - hash) & table_mask_)) continue; // the chain has no gaps
+	auto new_node = nodes_ + target;
+	new (static_cast<void*>(new_node)) Node(std::move(*node));
+	node->~Node();
+	node->reset();
+	set_ctrl(nodes_, table_mask_, target, ctrl[i]);
+	set_ctrl(nodes_, table_mask_, i, ctrl_empty);
+	if (new_node->get_children()) levels_[new_node->get_children()].set_owner(new_node);
+      }
+      num_tombstones_ = 0;
+    }
+
+    // rehash_node returns the hash of an assigned Node, which doesn't depend on the size of the array
+    static size_t rehash_node(const Node * node) {
+      if constexpr (compact_nodes) {
+	return node->get_hash();
+      } else {
+	// get the least significant byte of depth from node, and the other bytes from the prefix key
+	size_t depth = ((keysize(node->get_prefix_key(), digits{}) + 1) & ~UINT64_C(0xff)) | node->get_depth_lsb();
+	return calc_final_hash(calc_unordered_hash(depth, calc_prefix_hash(depth, node->get_prefix_key())), node->get_ordinal());
+      }
+    }
+
+    // move_node moves an assigned Node to the given array, and leaves the old Node destroyed
+    void move_node(Node * node, Node * new_nodes, size_t new_mask) {
+      auto hash = rehash_node(node);
+      auto i = find_free_slot(new_nodes, new_mask, hash);
+      num_insert_collisions_ += (i - hash) & new_mask;
+      set_ctrl(new_nodes, new_mask, i, get_tag(hash));
+      auto new_node = new_nodes + i;
+      if (new_node->is_tombstone()) num_tombstones_--; // only during an incremental resize
+      new (static_cast<void*>(new_node)) Node(std::move(*node));
+      node->~Node();
+      if (new_node->get_children()) levels_[new_node->get_children()].set_owner(new_node);
+    }
+
+    // move_nodes_parallel moves all the Nodes to the given array. The current array is split into
+    // contiguous partitions, one per thread, and the threads claim the new slots atomically.
+    void move_nodes_parallel(Node * new_nodes, size_t new_mask, size_t threads) {
+      std::vector<size_t> collisions(threads);
+      auto move_partition = [&](size_t p) {
+	auto node = nodes_ + table_size_ / threads * p;
+	auto end = p + 1 == threads ? nodes_ + table_size_ : node + table_size_ / threads;
+	size_t n = 0;
+	for (; node != end; node++) {
+	  if (!node->is_assigned()) continue;
+	  auto hash = rehash_node(node);
+	  auto i = hash & new_mask;
+	  while (!new_nodes[i].try_claim(*node)) {
+	    i = (i + 1) & new_mask;
+	    n++;
+	  }
+	  set_ctrl(new_nodes, new_mask, i, get_tag(hash));
+	  auto new_node = new_nodes + i;
+	  new_node->move_claimed(std::move(*node));
+	  node->~Node();
+	  if (new_node->get_children()) levels_[new_node->get_children()].set_owner(new_node);
+	}
+	collisions[p] = n;
+      };
+
+      std::vector<std::thread> workers;
+      workers.reserve(threads - 1);
+      for (size_t p = 1; p < threads; p++) {
+	try {
+	  workers.emplace_back(move_partition, p);
+	} catch (const std::system_error &) {
+	  move_partition(p); // out of threads, so do the work here
+	}
+      }
+      move_partition(0);
+      for (auto & w : workers) w.join();
+      for (auto n : collisions) num_insert_collisions_ += n;
+    }
+
+    // migrate moves up to n slots of the old array to the current array during an incremental resize.
+    // The moved Nodes are replaced by tombstones, so that the probe chains in the old array stay intact.
+    void migrate(size_t n) {
+      auto end = std::min(migrate_pos_ + n, old_mask_ + 1);
+      for (; migrate_pos_ < end; migrate_pos_++) {
+	auto node = old_nodes_ + migrate_pos_;
+	if (node->is_assigned()) {
+	  move_node(node, nodes_, table_mask_);
+	  node->set_tombstone();
+	  set_ctrl(old_nodes_, old_mask_, migrate_pos_, ctrl_tombstone);
+	}
+      }
+      if (migrate_pos_ > old_mask_) {
+	free_nodes(old_nodes_, old_mask_ + 1);
+	old_nodes_ = nullptr;
+      }
+    }
+
+    // matches returns true if a compact Node with the same depth, ordinal and hash has the prefix key. If the Level
+    // containing the Node is known it is enough to compare it. A final Node is compared with its key, and otherwise
+    // the digits of the prefix are compared with the ordinals of the owners of the Levels on the way to the root.
+    template <typename K>
+    bool matches(const Node * node, size_t depth, const K & prefix_key, uint32_t level) const noexcept {
+      if constexpr (compact_nodes) {
+	if (level != no_level) return node->get_parent() == level;
+	if (node->get_payload() && !node->is_head()) {
+	  std::string_view key(getFirstConst(*node->get_payload()));
+	  return key.size() == depth && key.substr(0, depth - 1) == std::string_view(prefix_key);
+	}
+	if (!depth) return false;
+	std::string_view prefix(prefix_key);
+	level = node->get_parent();
+	for (size_t i = depth - 1; i > 0; i--) {
+	  if (level == no_level || level == root_level) return false;
+	  auto & l = levels_[level];
+	  if (l.get_owner()->get_ordinal() != static_cast<uint8_t>(prefix[i - 1])) return false;
+	  level = l.get_parent();
+	}
+	return level == root_level;
+      } else {
+	return true; // the prefix key has been compared already
+      }
+    }
+
+    // find_candidate returns the first Node in the probe chain of the hash for which f returns true, or null.
+    // The first slots are tested directly, since most Nodes are there, and the control bytes would be another
+    // cache miss. After them, only the Nodes whose control byte matches the hash are passed to f.
+    template <typename F>
+    static Node * find_candidate(Node * nodes, size_t mask, size_t hash, F f) noexcept {
+      for (size_t offset = 0; offset < direct_probe_slots; offset++) {
+	auto node = nodes + ((hash + offset) & mask);
+	if (node->is_assigned()) {
+	  if (f(node)) return node;
+	} else if (!node->is_tombstone()) {
+	  return nullptr;
+	}
+      }
+      auto ctrl = get_ctrl(nodes, mask + 1);
+      auto tag = get_tag(hash);
+      for (size_t offset = direct_probe_slots; offset <= mask; offset += ControlGroup::width) {
+	ControlGroup group(ctrl + ((hash + offset) & mask));
+	for (auto m = group.match(tag); m; m &= m - 1) {
+	  auto node = nodes + ((hash + offset + ControlGroup::index(m)) & mask);
+	  if (f(node)) return node;
+	}
+	if (group.match(ctrl_empty)) break;
+      }
+      return nullptr;
+    }
+
+    // probe returns the Node with given depth, prefix key and ordinal from the array, or null if there is none
+    template <typename K>
+    Node * probe(Node * nodes, size_t mask, size_t hash, size_t depth, const K & prefix_key, size_t ordinal, uint32_t level) const noexcept {
+      return find_candidate(nodes, mask, hash, [&](const Node * node) {
+	return node->equals(depth, prefix_key, ordinal, hash) && matches(node, depth, prefix_key, level);
+      });
+    }
+
+    // find_node returns the Node with given depth, prefix key and ordinal, or null if there is none.
+    // The Nodes of the first digit are usually not hashed at all, but read from top_ by their ordinal.
+    // During an incremental resize the Nodes that haven't been moved yet are still in the old array.
+    // The Level containing the Node can be given if it is known, so that compact Nodes are matched faster.
+    template <typename K>
+    Node * find_node(size_t hash, size_t depth, const K & prefix_key, size_t ordinal, uint32_t level = no_level) const noexcept {
+      if (direct_top && depth == 1) {
+	auto node = top_ + ordinal;
+	return node->is_assigned() ? node : nullptr;
+      }
+      if (auto node = probe(nodes_, table_mask_, hash, depth, prefix_key, ordinal, level)) return node;
+      return old_nodes_ ? probe(old_nodes_, old_mask_, hash, depth, prefix_key, ordinal, level) : nullptr;
+    }
+
+    bool is_top_node(const Node * node) const noexcept { return direct_top && node >= top_ && node < top_ + bucket_count; }
+
+    // find_payload_node returns the Node holding the payload, or null if there is none. The depth and ordinal
+    // are compared as well, since the head of a compressed path holds the same payload as its final Node.
+    Node * find_payload_node(size_t hash, size_t depth, size_t ordinal, const value_type * payload) const noexcept {
+      for (auto [ nodes, mask ] : { std::pair(nodes_, table_mask_), std::pair(old_nodes_, old_mask_) }) {
+	if (!nodes) continue;
+	auto node = find_candidate(nodes, mask, hash, [&](const Node * n) {
+	  return holds_value(n, payload) && n->get_depth_lsb() == (depth & 0xff) && n->get_ordinal() == ordinal;
+	});
+	if (node) return node;
+      }
+      return nullptr;
+    }
+
+    // same_value compares inline payloads by their bits, so that distinct keys such as 0.0 and -0.0 are distinct
+    static bool same_value(const InlineValue & a, const InlineValue & b) noexcept {
+      return std::memcmp(&a, &b, sizeof(InlineValue)) == 0;
+    }
+
+    // holds_value returns true if the Node holds the payload, or a copy of it if the payload is inline
+    static bool holds_value(const Node * node, const value_type * payload) noexcept {
+      if constexpr (inline_payload) {
+	auto p = node->get_payload();
+	return p && payload && same_value(*p, *payload);
+      } else {
+	return node->get_payload() == payload;
+      }
+    }
+
+    // store_value constructs the value of a new key, and stores it in its final Node and in the head of its
+    // compressed path. Inline payloads are copied into the Nodes, and the others are allocated from the Arena.
+    template <typename V>
+    value_type * store_value(Node * node, Node * head, V && v) {
+      if constexpr (inline_payload) {
+	value_type vt(std::forward<V>(v));
+	node->set_payload(&vt);
+      } else {
+	auto payload = arena_.alloc();
+	new (static_cast<void*>(payload)) value_type(std::forward<V>(v));
+	node->set_payload(payload);
+      }
+      if (head) head->set_payload(node->get_payload());
+      return node->get_payload();
+    }
+
+    // keep_payload returns the payload of a Node so that it stays valid when the Node is released.
+    // An inline payload is copied to the given variable first.
+    static value_type * keep_payload(Node * node, InlineValue & copy) noexcept {
+      if constexpr (inline_payload) {
+	copy = *node->get_payload();
+	return &copy;
+      } else {
+	return node->get_payload();
+      }
+    }
+
+    // returns the value inserted last with the end() hint, or null
+    const value_type * get_append_hint() const noexcept {
+      if constexpr (inline_payload) {
+	return append_hint_ ? &append_value_ : nullptr;
+      } else {
+	return append_hint_;
+      }
+    }
+
+    // get_offset returns the probe offset of the Node, or zero if it is in the old array
+    size_t get_offset(const Node * node, size_t hash) const noexcept {
+      if (node >= nodes_ && node < nodes_ + table_size_) {
+	return static_cast<size_t>(node - nodes_ - static_cast<std::ptrdiff_t>(hash & table_mask_)) & table_mask_;
+      } else {
+	return 0;
+      }
     }
 
     Node * read_node(size_t h, size_t offset) noexcept {return nodes_ + ((h + offset) & table_mask_); }
-    const Node * read_node(size_t h, size_t offset) const noexcept { return nodes_ + (h + offset) & table_mask_; }
+    const Node * read_node(size_t h, size_t offset) const noexcept { return nodes_ + ((h + offset) & table_mask_); }
 
     Node * read_node(size_t h) noexcept { return nodes_ + (h & table_mask_); }
     const Node * read_node(size_t h) const noexcept { return nodes_ + (h & table_mask_); }
 
-    const Node * get_nodes_start() const noexcept { return nodes_; }
-    const Node * get_nodes_end() const noexcept { return nodes_ + table_size_; }
-    Node * get_nodes_start() noexcept { return nodes_; }
-    Node * get_nodes_end()  noexcept { return nodes_ + table_size_; }
+    // The prefix hash is a polynomial hash of the digits of the prefix key, and it can be
+    // extended or truncated by one digit in constant time. The multiplier is odd, which
+    // makes it invertible.
+    static constexpr size_t prefix_hash_multiplier = static_cast<size_t>(UINT64_C(0x9e3779b97f4a7c15));
+    static constexpr size_t prefix_hash_inverse = calc_multiplicative_inverse(prefix_hash_multiplier);
 
-    // hash calculation functions use Murmur3 to calculate hash for a Node.
-    // Murmur3 operations are specialized for both 32 bit and 64 bit size_t
-    static inline size_t calc_unordered_hash(size_t depth, const internal_key_type & prefix_key) noexcept {
-      auto k1 = murmur3_mix_k1(std::hash<internal_key_type>{}(prefix_key));
-      return murmur3_mix_h1(depth, k1);
+    static inline size_t extend_prefix_hash(size_t h, size_t digit) noexcept {
+      return h * prefix_hash_multiplier + digit + 1;
+    }
+
+    static inline size_t truncate_prefix_hash(size_t h, size_t digit) noexcept {
+      return (h - digit - 1) * prefix_hash_inverse;
+    }
+
+    // calculates the prefix hash for the prefix key of a Node of given depth
+    template <typename K>
+    static size_t calc_prefix_hash(size_t depth, const K & prefix_key) noexcept {
+      size_t h = 0;
+      if constexpr (std::is_convertible<const K &, std::string_view>::value) {
+	for (auto c : std::string_view(prefix_key)) {
+	  h = extend_prefix_hash(h, static_cast<uint8_t>(c));
+	}
+      } else {
+	// go through the digits from least significant to most significant
+	K key = prefix_key;
+	size_t power = 1;
+	for (size_t i = 1; i < depth; i++) {
+	  auto [ ordinal, next_key ] = deconstruct(std::move(key), digits{});
+	  h += (ordinal + 1) * power;
+	  power *= prefix_hash_multiplier;
+	  key = std::move(next_key);
+	}
+      }
+      return h;
+    }
+
+    // hash calculation functions pass the depth, prefix hash and ordinal of a Node to the hash policy
+    static inline size_t calc_unordered_hash(size_t depth, size_t prefix_hash) noexcept {
+      return Hash::calc_unordered_hash(depth, prefix_hash);
     }
 
     static inline size_t calc_final_hash(size_t h1, size_t ordinal) noexcept {
-      auto k1 = murmur3_mix_k1(ordinal);
-      h1 = murmur3_mix_h1(h1, k1);
-      return murmur3_fmix(h1);
+      return Hash::calc_final_hash(h1, ordinal);
     }
 
     size_t num_entries_ = 0, num_final_entries_ = 0;
-    size_t num_inserts_ = 0, num_insert_collisions_ = 0;
+    size_t num_inserts_ = 0, num_insert_collisions_ = 0, num_resizes_ = 0;
+    size_t num_merges_ = 0; // the number of compressed paths created by erase, which invalidates the cached Levels
+    size_t num_tombstones_ = 0; // the tombstones in the current node array
     size_t table_size_ = 0, table_mask_ = 0;
     size_t inserts_remaining_ = 0;
+    rebind_alloc<Node> node_alloc_;
     Node* nodes_ = nullptr;
+    Node* top_ = nullptr; // the Nodes of the first digit, indexed directly by the ordinal
     Arena arena_;
+    LevelPool levels_;
+    std::vector<uint32_t, rebind_alloc<uint32_t>> free_levels_;
+    const value_type * append_hint_ = nullptr; // the value inserted last with the end() hint, or null
+    InlineValue append_value_ = InlineValue(); // the copy of an inline payload, whose append_hint_ is only a mark
+    uint32_t append_level_ = no_level;
+    // the old node array during an incremental resize, and the next slot to move
+    bool incremental_resize_ = false;
+    Node * old_nodes_ = nullptr;
+    size_t old_mask_ = 0, migrate_pos_ = 0;
+    // the file mapping of a loaded table, which holds the nodes, the Levels and the payloads
+    void * mapping_ = nullptr;
+    size_t mapping_size_ = 0;
   };
 
-  template <typename Key>
-  using set = Table<Key, void>;
+  template <typename Key, size_t DigitBits = 8, typename Hash = murmur3_hash, typename Allocator = std::allocator<Key>>
+  using set = Table<Key, void, DigitBits, Hash, Allocator>;
+
+  template <typename Key, typename Value, size_t DigitBits = 8, typename Hash = murmur3_hash, typename Allocator = std::allocator<std::pair<Key, Value>>>
+  using map = Table<Key, Value, DigitBits, Hash, Allocator>;
 
-  template <typename Key, typename Value>
-  using map = Table<Key, Value>;
+#ifdef RADIX_CPP_PMR
+  // sets and maps whose memory comes from a std::pmr::memory_resource
+  namespace pmr {
+    template <typename Key, size_t DigitBits = 8, typename Hash = murmur3_hash>
+    using set = Table<Key, void, DigitBits, Hash, std::pmr::polymorphic_allocator<Key>>;
+
+    template <typename Key, typename Value, size_t DigitBits = 8, typename Hash = murmur3_hash>
+    using map = Table<Key, Value, DigitBits, Hash, std::pmr::polymorphic_allocator<std::pair<Key, Value>>>;
+  };
+#endif
 };
 
 #endif
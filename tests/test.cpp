@@ -5,6 +5,14 @@
 #include <iostream>
 #include <limits>
 #include <cmath>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <list>
+#include <sstream>
+#include <new>
 
 TEST_CASE( "simple integer sets can be created", "[int_set]" ) {
   radix_cpp::set<uint8_t> S0;
@@ -533,3 +541,1261 @@ TEST_CASE( "subnormal numbers", "[subnormals]") {
   REQUIRE(*it++ == 1.0);
   REQUIRE(it == S.end());
 }
+
+TEST_CASE( "sparse integer set iteration", "[sparse_iteration]") {
+  radix_cpp::set<uint64_t> S;
+  std::vector<uint64_t> V;
+  for (uint64_t i = 0; i < 1000; i++) {
+    V.push_back(i * UINT64_C(0x9e3779b97f4a7c15));
+  }
+  for (auto v : V) S.insert(v);
+  std::sort(V.begin(), V.end());
+  auto it = S.begin();
+  for (auto v : V) {
+    REQUIRE(it != S.end());
+    REQUIRE(*it++ == v);
+  }
+  REQUIRE(it == S.end());
+
+  // erasing every other key must also remove the empty subtrees from iteration
+  for (size_t i = 0; i < V.size(); i += 2) {
+    REQUIRE(S.erase(V[i]) == 1);
+  }
+  it = S.begin();
+  for (size_t i = 1; i < V.size(); i += 2) {
+    REQUIRE(it != S.end());
+    REQUIRE(*it++ == V[i]);
+  }
+  REQUIRE(it == S.end());
+}
+
+TEST_CASE( "long string keys with shared prefixes survive resizing", "[string_resize]") {
+  radix_cpp::set<std::string> S;
+  std::vector<std::string> V;
+  for (size_t i = 0; i < 5000; i++) {
+    V.push_back("https://example.com/a/rather/long/path/" + std::to_string(i * 7919 % 5000) + "/index.html");
+  }
+  for (auto & v : V) S.insert(v);
+  REQUIRE(S.size() == V.size());
+  for (auto & v : V) {
+    auto it = S.find(v);
+    REQUIRE(it != S.end());
+    REQUIRE(*it == v);
+  }
+  std::sort(V.begin(), V.end());
+  auto it = S.begin();
+  for (auto & v : V) {
+    REQUIRE(*it++ == v);
+  }
+  REQUIRE(it == S.end());
+}
+
+TEST_CASE( "heterogeneous lookup with string_view", "[string_view_lookup]") {
+  radix_cpp::set<std::string> S;
+  S.insert("GET /index.html");
+  S.insert("GET /images/logo.png");
+  S.insert("POST /api/v1/orders");
+
+  const char buffer[] = "POST /api/v1/orders HTTP/1.1";
+  std::string_view request(buffer, 19);
+
+  auto it = S.find(request);
+  REQUIRE(it != S.end());
+  REQUIRE(*it == "POST /api/v1/orders");
+  REQUIRE(S.count(request) == 1);
+  REQUIRE(S.count(std::string_view(buffer, 18)) == 0);
+  REQUIRE(S.count("GET /index.html") == 1);
+
+  // an iterator returned by a string_view lookup can be advanced
+  it = S.find(std::string_view("GET /images/logo.png"));
+  REQUIRE(*it++ == "GET /images/logo.png");
+  REQUIRE(*it++ == "GET /index.html");
+  REQUIRE(*it++ == "POST /api/v1/orders");
+  REQUIRE(it == S.end());
+
+  REQUIRE(S.upper_bound(std::string_view("GET /j")) == S.find("POST /api/v1/orders"));
+  REQUIRE(S.erase(request) == 1);
+  REQUIRE(S.erase(request) == 0);
+  REQUIRE(S.size() == 2);
+
+  radix_cpp::map<std::string, int> M;
+  M["key"] = 1;
+  REQUIRE(M.find(std::string_view("key"))->second == 1);
+}
+
+TEST_CASE( "reserve avoids resizing during inserts", "[reserve]") {
+  radix_cpp::set<uint32_t> S;
+  S.reserve(100000);
+  auto resizes = S.num_resizes();
+  for (uint32_t i = 0; i < 100000; i++) {
+    S.insert(i * 2654435761u);
+  }
+  REQUIRE(S.num_resizes() == resizes);
+  REQUIRE(S.size() == 100000);
+
+  // rehash never drops entries, even when asked to shrink
+  S.rehash(0);
+  REQUIRE(S.size() == 100000);
+  REQUIRE(S.count(2654435761u) == 1);
+
+  std::vector<uint64_t> V;
+  for (uint64_t i = 0; i < 10000; i++) V.push_back(i << 40);
+  radix_cpp::set<uint64_t> S2;
+  S2.insert(V.begin(), V.end());
+  REQUIRE(S2.num_resizes() <= 1);
+  REQUIRE(S2.size() == V.size());
+}
+
+TEST_CASE( "bulk construction from a range", "[assign]") {
+  std::vector<int64_t> V;
+  for (int64_t i = 0; i < 20000; i++) V.push_back((i * 7919) % 10007 - 5000);
+  radix_cpp::set<int64_t> S(V.begin(), V.end());
+  std::sort(V.begin(), V.end());
+  V.erase(std::unique(V.begin(), V.end()), V.end());
+  REQUIRE(S.size() == V.size());
+  auto it = S.begin();
+  for (auto & v : V) {
+    REQUIRE(*it++ == v);
+  }
+  REQUIRE(it == S.end());
+
+  // the table stays consistent after erasing and inserting
+  for (auto & v : V) {
+    if (v % 3 == 0) REQUIRE(S.erase(v) == 1);
+  }
+  S.insert(100000);
+  size_t n = 0;
+  for (auto & v : S) {
+    REQUIRE((v % 3 != 0 || v == 100000));
+    n++;
+  }
+  REQUIRE(n == S.size());
+
+  std::vector<std::string> W = { "b", "", "abc", "ab", "b", "abd", "a", "ba" };
+  radix_cpp::set<std::string> S2;
+  S2.insert("old");
+  S2.assign(W.begin(), W.end());
+  std::sort(W.begin(), W.end());
+  W.erase(std::unique(W.begin(), W.end()), W.end());
+  REQUIRE(std::vector<std::string>(S2.begin(), S2.end()) == W);
+  REQUIRE(S2.count("old") == 0);
+
+  // forward ranges are read in place and left as they are, and other ranges are copied first
+  std::list<std::string> L = { "b", "ab", "", "ba", "ab" };
+  S2.assign(L.begin(), L.end());
+  REQUIRE(std::vector<std::string>(S2.begin(), S2.end()) == std::vector<std::string>({ "", "ab", "b", "ba" }));
+  REQUIRE(L.front() == "b");
+  REQUIRE(L.back() == "ab");
+  const char * C[] = { "ba", "a", "ba" };
+  S2.assign(std::begin(C), std::end(C));
+  REQUIRE(std::vector<std::string>(S2.begin(), S2.end()) == std::vector<std::string>({ "a", "ba" }));
+  std::istringstream input("7 3 7 1");
+  radix_cpp::set<uint32_t> S3(std::istream_iterator<uint32_t>(input), (std::istream_iterator<uint32_t>()));
+  REQUIRE(std::vector<uint32_t>(S3.begin(), S3.end()) == std::vector<uint32_t>({ 1, 3, 7 }));
+
+  // the first of the equal keys is stored
+  std::vector<std::pair<uint32_t, int>> P = { { 5, 1 }, { 3, 2 }, { 5, 3 } };
+  radix_cpp::map<uint32_t, int> M(P.begin(), P.end());
+  REQUIRE(M.size() == 2);
+  REQUIRE(M[5] == 1);
+  REQUIRE(M[3] == 2);
+  REQUIRE(P[0].second == 1);
+}
+
+TEST_CASE( "hinted insert", "[hint]") {
+  radix_cpp::set<uint64_t> S;
+  for (uint64_t i = 0; i < 5000; i++) {
+    S.insert(S.end(), 1000000 + i * 3);
+  }
+  REQUIRE(S.size() == 5000);
+  uint64_t expected = 1000000;
+  for (auto & v : S) {
+    REQUIRE(v == expected);
+    expected += 3;
+  }
+
+  // hints that don't share the prefix of the key are ignored
+  auto it = S.insert(S.find(1000000), 1);
+  REQUIRE(*it == 1);
+  it = S.insert(it, 2);
+  REQUIRE(*it == 2);
+  it = S.insert(it, 2);
+  REQUIRE(*it == 2);
+  REQUIRE(S.size() == 5002);
+  REQUIRE(*S.begin() == 1);
+
+  for (uint64_t i = 0; i < 5000; i++) {
+    REQUIRE(S.erase(1000000 + i * 3) == 1);
+  }
+  REQUIRE(S.erase(1) == 1);
+  REQUIRE(S.erase(2) == 1);
+  REQUIRE(S.empty());
+  REQUIRE(S.begin() == S.end());
+
+  radix_cpp::map<std::string, int> M;
+  auto mit = M.insert(M.end(), std::pair(std::string("ab"), 1));
+  mit = M.insert(mit, std::pair(std::string("ac"), 2));
+  M.insert(mit, std::pair(std::string("a"), 3));
+  REQUIRE(M.size() == 3);
+  REQUIRE(M["ab"] == 1);
+  REQUIRE(M["ac"] == 2);
+  REQUIRE(M.begin()->second == 3);
+}
+
+TEST_CASE( "incremental resize", "[incremental_resize]") {
+  radix_cpp::set<uint32_t> S;
+  S.set_incremental_resize(true);
+  for (uint32_t i = 0; i < 50000; i++) {
+    S.insert(i * 7919);
+    if (i % 1000 == 0) {
+      // lookups and iteration see the Nodes in both arrays during the resize
+      REQUIRE(S.count(0) == 1);
+      REQUIRE(S.count(i * 7919) == 1);
+      REQUIRE(S.count(i * 7919 + 1) == 0);
+      size_t n = 0;
+      for (auto it = S.begin(); it != S.end(); ++it) n++;
+      REQUIRE(n == S.size());
+    }
+  }
+  REQUIRE(S.size() == 50000);
+  REQUIRE(S.num_resizes() > 0);
+
+  for (uint32_t i = 0; i < 50000; i += 2) {
+    REQUIRE(S.erase(i * 7919) == 1);
+  }
+  REQUIRE(S.size() == 25000);
+  std::vector<uint32_t> V(S.begin(), S.end());
+  REQUIRE(V.size() == 25000);
+  REQUIRE(std::is_sorted(V.begin(), V.end()));
+  REQUIRE(V.front() == 7919);
+}
+
+TEST_CASE( "parallel rehash", "[rehash]") {
+  radix_cpp::set<uint32_t> S;
+  for (uint32_t i = 0; i < 200000; i++) {
+    S.insert(i * 7919);
+  }
+  auto resizes = S.num_resizes();
+  S.rehash(4 << 20, 4);
+  REQUIRE(S.num_resizes() == resizes + 1);
+  REQUIRE(S.size() == 200000);
+  for (uint32_t i = 0; i < 200000; i++) {
+    REQUIRE(S.count(i * 7919) == 1);
+  }
+  std::vector<uint32_t> V(S.begin(), S.end());
+  REQUIRE(V.size() == 200000);
+  REQUIRE(std::is_sorted(V.begin(), V.end()));
+
+  // the moved Nodes can still be erased, along with their ancestors
+  for (uint32_t i = 0; i < 200000; i++) {
+    REQUIRE(S.erase(i * 7919) == 1);
+  }
+  REQUIRE(S.empty());
+  REQUIRE(S.begin() == S.end());
+
+  radix_cpp::map<std::string, int> M;
+  for (int i = 0; i < 50000; i++) {
+    M[std::to_string(i)] = i;
+  }
+  M.rehash(1 << 20, 8);
+  REQUIRE(M.size() == 50000);
+  for (int i = 0; i < 50000; i++) {
+    REQUIRE(M[std::to_string(i)] == i);
+  }
+}
+
+TEST_CASE( "first digit nodes", "[top]") {
+  radix_cpp::set<uint8_t> S;
+  for (int i = 255; i >= 0; i -= 2) {
+    S.insert(static_cast<uint8_t>(i));
+  }
+  REQUIRE(S.size() == 128);
+  REQUIRE(*S.begin() == 1);
+  REQUIRE(S.count(0) == 0);
+  REQUIRE(S.count(255) == 1);
+  for (int i = 1; i < 256; i += 2) {
+    REQUIRE(S.erase(static_cast<uint8_t>(i)) == 1);
+  }
+  REQUIRE(S.empty());
+  REQUIRE(S.begin() == S.end());
+
+  radix_cpp::map<std::string, int> M;
+  M["b"] = 1;
+  M["ba"] = 2;
+  M["a"] = 3;
+  REQUIRE(M.erase("b") == 1);
+  REQUIRE(M.begin()->second == 3);
+  REQUIRE(M["ba"] == 2);
+  REQUIRE(M.erase("ba") == 1);
+  REQUIRE(M.size() == 1);
+}
+
+TEST_CASE( "digit widths", "[digits]") {
+  std::vector<int64_t> keys;
+  uint64_t x = 1;
+  for (int i = 0; i < 3000; i++) {
+    x = x * 6364136223846793005 + 1442695040888963407;
+    keys.push_back(static_cast<int64_t>(x) >> (i % 40));
+  }
+  std::vector<int64_t> sorted = keys;
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+  auto check = [&](auto S) {
+    for (auto k : keys) S.insert(k);
+    REQUIRE(S.size() == sorted.size());
+    REQUIRE(std::vector<int64_t>(S.begin(), S.end()) == sorted);
+    for (auto k : sorted) REQUIRE(S.count(k) == 1);
+    REQUIRE(S.count(sorted.front() + 1) == (sorted[1] == sorted.front() + 1));
+    for (size_t i = 0; i < sorted.size(); i += 2) REQUIRE(S.erase(sorted[i]) == 1);
+    std::vector<int64_t> odd;
+    for (size_t i = 1; i < sorted.size(); i += 2) odd.push_back(sorted[i]);
+    REQUIRE(std::vector<int64_t>(S.begin(), S.end()) == odd);
+
+    decltype(S) T(keys.begin(), keys.end());
+    REQUIRE(std::vector<int64_t>(T.begin(), T.end()) == sorted);
+  };
+  check(radix_cpp::set<int64_t, 4>());
+  check(radix_cpp::set<int64_t, 8>());
+  check(radix_cpp::set<int64_t, 16>());
+  check(radix_cpp::set<int64_t, 1>());
+
+  radix_cpp::map<uint8_t, int, 4> M;
+  for (int i = 0; i < 256; i++) M[static_cast<uint8_t>(255 - i)] = i;
+  REQUIRE(M.size() == 256);
+  int expected = 0;
+  for (auto & [ k, v ] : M) REQUIRE(k == expected++);
+  REQUIRE(M[17] == 238);
+
+  radix_cpp::set<double, 16> D;
+  D.insert(-1.5);
+  D.insert(2.5);
+  D.insert(0.0);
+  std::vector<double> expected_doubles = { -1.5, 0.0, 2.5 };
+  REQUIRE(std::vector<double>(D.begin(), D.end()) == expected_doubles);
+}
+
+TEST_CASE( "compressed paths", "[compress]") {
+  radix_cpp::set<std::string> S;
+  std::string base = "/var/lib/data/" + std::string(100, 'x');
+  auto it = S.insert(base + "/a").first;
+  REQUIRE(*it == base + "/a");
+
+  // split the compressed path at different depths
+  S.insert(base + "/b");
+  S.insert(base.substr(0, 20));
+  S.insert(base + "/a/deeper");
+  S.insert(base.substr(0, 10) + "z");
+  REQUIRE(*it == base + "/a");
+  ++it;
+  REQUIRE(*it == base + "/a/deeper");
+  ++it;
+  REQUIRE(*it == base + "/b");
+  ++it;
+  REQUIRE(*it == base.substr(0, 10) + "z");
+
+  std::vector<std::string> expected = { base.substr(0, 20), base + "/a", base + "/a/deeper", base + "/b", base.substr(0, 10) + "z" };
+  REQUIRE(std::vector<std::string>(S.begin(), S.end()) == expected);
+  for (auto & k : expected) REQUIRE(S.count(k) == 1);
+  REQUIRE(S.count(base) == 0);
+  REQUIRE(S.count(base + "/") == 0);
+  REQUIRE(S.count(base + "/a/deep") == 0);
+
+  REQUIRE(*S.upper_bound(base) == base + "/a");
+  REQUIRE(*S.upper_bound(base + "/a/d") == base + "/a/deeper");
+  REQUIRE(*S.upper_bound(base + "/a/e") == base + "/b");
+  REQUIRE(*S.upper_bound(base + "/c") == base.substr(0, 10) + "z");
+  REQUIRE(S.upper_bound(base.substr(0, 10) + "zz") == S.end());
+
+  // erasing merges the paths back, and the iterators to the remaining keys stay valid
+  auto last = S.find(base.substr(0, 10) + "z");
+  REQUIRE(S.erase(base + "/a") == 1);
+  REQUIRE(S.erase(base.substr(0, 20)) == 1);
+  REQUIRE(*last == base.substr(0, 10) + "z");
+  it = S.find(base + "/a/deeper");
+  REQUIRE(S.erase(base + "/b") == 1);
+  REQUIRE(*it == base + "/a/deeper");
+  ++it;
+  REQUIRE(it == last);
+  expected = { base + "/a/deeper", base.substr(0, 10) + "z" };
+  REQUIRE(std::vector<std::string>(S.begin(), S.end()) == expected);
+  REQUIRE(*S.upper_bound(base) == base + "/a/deeper");
+  REQUIRE(S.erase(S.begin()) == last);
+  REQUIRE(S.erase(last) == S.end());
+  REQUIRE(S.empty());
+
+  // sparse integers only share their first digits
+  std::vector<uint64_t> keys;
+  uint64_t x = 7;
+  for (int i = 0; i < 2000; i++) {
+    x = x * 6364136223846793005 + 1442695040888963407;
+    keys.push_back(x);
+  }
+  radix_cpp::set<uint64_t> U(keys.begin(), keys.end()), V;
+  for (auto k : keys) V.insert(k);
+  std::sort(keys.begin(), keys.end());
+  REQUIRE(std::vector<uint64_t>(U.begin(), U.end()) == keys);
+  REQUIRE(std::vector<uint64_t>(V.begin(), V.end()) == keys);
+  for (size_t i = 0; i < keys.size(); i++) {
+    REQUIRE(*U.upper_bound(keys[i] - 1) == keys[i]);
+    if (i % 3) REQUIRE(V.erase(keys[i]) == 1);
+  }
+  std::vector<uint64_t> rest;
+  for (size_t i = 0; i < keys.size(); i += 3) rest.push_back(keys[i]);
+  REQUIRE(std::vector<uint64_t>(V.begin(), V.end()) == rest);
+}
+
+TEST_CASE( "long string keys", "[compact]") {
+  // the keys share prefixes longer than 256 digits, so the depths of their Nodes wrap around in the Nodes
+  std::vector<std::string> keys;
+  for (int i = 0; i < 600; i++) {
+    std::string s(static_cast<size_t>(250 + (i * 7) % 40), 'a');
+    for (int j = i; j; j /= 3) s += static_cast<char>('a' + j % 3);
+    keys.push_back(s);
+  }
+  radix_cpp::map<std::string, int> M;
+  M.set_incremental_resize(true);
+  for (size_t i = 0; i < keys.size(); i++) M[keys[i]] = static_cast<int>(i);
+  auto sorted = keys;
+  std::sort(sorted.begin(), sorted.end());
+  sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+  REQUIRE(M.size() == sorted.size());
+  auto it = M.begin();
+  for (auto & k : sorted) {
+    REQUIRE(it->first == k);
+    ++it;
+  }
+  REQUIRE(it == M.end());
+  for (size_t i = 0; i < keys.size(); i++) {
+    REQUIRE(M.count(keys[i]) == 1);
+    REQUIRE(M.count(keys[i] + "a") == (std::find(keys.begin(), keys.end(), keys[i] + "a") != keys.end()));
+  }
+
+  // erase every other key while the table shrinks, and the rest are still in order
+  std::vector<std::string> rest;
+  for (size_t i = 0; i < sorted.size(); i++) {
+    if (i % 2) REQUIRE(M.erase(sorted[i]) == 1);
+    else rest.push_back(sorted[i]);
+  }
+  std::vector<std::string> found;
+  for (auto & [ k, v ] : M) {
+    found.push_back(k);
+    REQUIRE(keys[static_cast<size_t>(v)] == k);
+  }
+  REQUIRE(found == rest);
+}
+
+TEST_CASE( "probing with control bytes", "[probe]") {
+  // tables smaller than a group of control bytes, and long probe chains of tombstones
+  radix_cpp::set<uint16_t, 2> S;
+  std::vector<uint16_t> keys;
+  for (uint16_t i = 0; i < 4; i++) {
+    S.insert(i);
+    keys.push_back(i);
+  }
+  REQUIRE(std::vector<uint16_t>(S.begin(), S.end()) == keys);
+  REQUIRE(S.count(4) == 0);
+
+  radix_cpp::set<uint32_t> U;
+  for (uint32_t round = 0; round < 4; round++) {
+    for (uint32_t i = 0; i < 20000; i++) U.insert(i * 2654435761u + round);
+    for (uint32_t i = 0; i < 20000; i += 2) REQUIRE(U.erase(i * 2654435761u + round) == 1);
+  }
+  REQUIRE(U.size() == 40000);
+  for (uint32_t round = 0; round < 4; round++) {
+    for (uint32_t i = 0; i < 20000; i++) {
+      REQUIRE(U.count(i * 2654435761u + round) == i % 2);
+    }
+  }
+  REQUIRE(std::is_sorted(U.begin(), U.end()));
+}
+
+TEST_CASE( "tombstone purging", "[tombstones]") {
+  // replace the keys of a set of constant size, which leaves tombstones instead of growing the table
+  radix_cpp::set<uint32_t> S;
+  uint32_t next = 0;
+  for (uint32_t i = 0; i < 10000; i++) {
+    S.insert(next * 2654435761u);
+    next++;
+  }
+  auto resizes = S.num_resizes();
+  for (uint32_t i = 0; i < 100000; i++) {
+    uint32_t old = (next - 10000) * 2654435761u;
+    REQUIRE(S.erase(old) == 1);
+    S.insert(next * 2654435761u);
+    next++;
+  }
+  REQUIRE(S.num_resizes() <= resizes + 2);
+
+  resizes = S.num_resizes();
+  S.compact();
+  REQUIRE(S.num_tombstones() == 0);
+  REQUIRE(S.num_resizes() == resizes);
+  std::vector<uint32_t> keys;
+  for (uint32_t i = next - 10000; i != next; i++) keys.push_back(i * 2654435761u);
+  std::sort(keys.begin(), keys.end());
+  REQUIRE(std::vector<uint32_t>(S.begin(), S.end()) == keys);
+  for (uint32_t i = next - 20000; i != next; i++) {
+    REQUIRE(S.count(i * 2654435761u) == (i >= next - 10000 ? 1 : 0));
+  }
+
+  radix_cpp::map<std::string, int> M;
+  M["a"] = 1;
+  M["ab"] = 2;
+  M["abc"] = 3;
+  M.erase("ab");
+  M.compact();
+  REQUIRE(M.num_tombstones() == 0);
+  REQUIRE(M.size() == 2);
+  REQUIRE(M["abc"] == 3);
+}
+
+TEST_CASE( "hash policies", "[hash]") {
+  radix_cpp::set<uint64_t, 8, radix_cpp::multiplicative_hash> S;
+  radix_cpp::set<uint64_t, 4, radix_cpp::wyhash_hash> S4;
+  std::vector<uint64_t> keys;
+  for (uint64_t i = 0; i < 20000; i++) {
+    auto k = i * i * 7919 + (i % 3 == 0 ? i << 40 : 0);
+    keys.push_back(k);
+    S.insert(k);
+    S4.insert(k);
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  REQUIRE(std::vector<uint64_t>(S.begin(), S.end()) == keys);
+  REQUIRE(std::vector<uint64_t>(S4.begin(), S4.end()) == keys);
+  for (size_t i = 0; i < keys.size(); i += 2) {
+    REQUIRE(S.erase(keys[i]) == 1);
+    REQUIRE(S4.count(keys[i]) == 1);
+  }
+  REQUIRE(S.size() == keys.size() / 2);
+  REQUIRE(S.count(keys[1]) == 1);
+
+  radix_cpp::map<std::string, size_t, 8, radix_cpp::wyhash_hash> M;
+  radix_cpp::map<std::string, size_t, 8, radix_cpp::multiplicative_hash> M2;
+  for (size_t i = 0; i < 5000; i++) {
+    auto k = "key/" + std::to_string(i * 31);
+    M[k] = i;
+    M2[k] = i;
+  }
+  REQUIRE(M.size() == 5000);
+  REQUIRE(M2.size() == 5000);
+  REQUIRE(M["key/31"] == 1);
+  REQUIRE(M2.find("key/62")->second == 2);
+  REQUIRE(std::equal(M.begin(), M.end(), M2.begin(), M2.end()));
+}
+
+TEST_CASE( "inline payloads", "[inline]") {
+  // the keys of sets of numbers are stored in the nodes, and the iterators are compared by the key
+  radix_cpp::set<double> D;
+  D.insert(0.0);
+  D.insert(-0.0);
+  D.insert(1.5);
+  REQUIRE(D.size() == 3);
+  auto it0 = D.find(0.0);
+  REQUIRE(it0 != D.end());
+  REQUIRE(it0 != D.find(-0.0));
+  REQUIRE(std::signbit(*D.begin()));
+
+  radix_cpp::set<uint32_t> S;
+  auto first = S.insert(1000).first;
+  auto it = S.insert(2000).first;
+  for (uint32_t i = 0; i < 100000; i++) {
+    S.insert(i * 2654435761u);
+  }
+  REQUIRE(*first == 1000);
+  REQUIRE(*it == 2000);
+  REQUIRE(it == S.find(2000));
+  REQUIRE(first != it);
+  ++first;
+  REQUIRE(*first == *S.upper_bound(1000));
+
+  // the hint and the erased value are copies of the key
+  auto hint = S.end();
+  for (uint32_t i = 0; i < 1000; i++) {
+    hint = S.insert(S.end(), 0xf0000000 + i);
+  }
+  REQUIRE(*hint == 0xf0000000 + 999);
+  REQUIRE(std::next(hint) == S.upper_bound(0xf0000000 + 999));
+  auto next = S.erase(S.find(0xf0000000 + 500));
+  REQUIRE(*next == 0xf0000000 + 501);
+  REQUIRE(S.count(0xf0000000 + 500) == 0);
+  REQUIRE(std::is_sorted(S.begin(), S.end()));
+}
+
+#ifdef RADIX_CPP_PMR
+// counts the bytes allocated through it, and passes the requests to the default resource
+struct counting_resource : std::pmr::memory_resource {
+  size_t allocated = 0, in_use = 0, peak = 0;
+  void * do_allocate(size_t bytes, size_t alignment) override {
+    allocated += bytes;
+    in_use += bytes;
+    peak = std::max(peak, in_use);
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+  }
+  void do_deallocate(void * p, size_t bytes, size_t alignment) override {
+    in_use -= bytes;
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const std::pmr::memory_resource & other) const noexcept override { return this == &other; }
+};
+
+TEST_CASE( "allocators", "[allocators]") {
+  counting_resource r1, r2;
+  {
+    radix_cpp::pmr::map<std::string, int> M(&r1);
+    for (int i = 0; i < 10000; i++) M["key" + std::to_string(i)] = i;
+    for (int i = 0; i < 10000; i += 2) M.erase("key" + std::to_string(i));
+    REQUIRE(M.size() == 5000);
+    REQUIRE(M["key1"] == 1);
+    REQUIRE(M.get_allocator().resource() == &r1);
+    REQUIRE(r1.allocated > 10000 * sizeof(std::pair<std::string, int>));
+
+    radix_cpp::pmr::set<uint32_t> S(&r2);
+    for (uint32_t i = 0; i < 10000; i++) S.insert(i * 7);
+    REQUIRE(r2.in_use > 0);
+
+    // the memory is released by the resource that allocated it
+    radix_cpp::pmr::set<uint32_t> S2(&r1);
+    S2.insert(1);
+    S2 = std::move(S);
+    REQUIRE(S2.get_allocator().resource() == &r2);
+    REQUIRE(S2.size() == 10000);
+    REQUIRE(S2.count(70) == 1);
+  }
+  REQUIRE(r1.in_use == 0);
+  REQUIRE(r2.in_use == 0);
+
+  std::pmr::monotonic_buffer_resource buffer;
+  radix_cpp::pmr::set<uint64_t> B(&buffer);
+  for (uint64_t i = 0; i < 1000; i++) B.insert(i << 20);
+  REQUIRE(B.size() == 1000);
+  REQUIRE(*B.begin() == 0);
+}
+#endif
+
+TEST_CASE( "huge page allocation", "[huge_pages]") {
+  using allocator = radix_cpp::huge_page_allocator<uint64_t>;
+  radix_cpp::set<uint64_t, 8, radix_cpp::murmur3_hash, allocator> S;
+  radix_cpp::set<uint64_t, 8, radix_cpp::murmur3_hash, allocator> S2(allocator(radix_cpp::numa_policy::interleave));
+  for (uint64_t i = 0; i < 300000; i++) {
+    S.insert(i * 0x9e3779b97f4a7c15);
+    S2.insert(i * 0x9e3779b97f4a7c15);
+  }
+  REQUIRE(S.size() == 300000);
+  REQUIRE(S2.get_allocator().get_policy() == radix_cpp::numa_policy::interleave);
+  REQUIRE(std::equal(S.begin(), S.end(), S2.begin(), S2.end()));
+  for (uint64_t i = 0; i < 300000; i += 3) {
+    REQUIRE(S2.erase(i * 0x9e3779b97f4a7c15) == 1);
+  }
+  REQUIRE(S2.size() == 200000);
+  REQUIRE(S2.count(0x9e3779b97f4a7c15) == 1);
+
+  radix_cpp::map<std::string, int, 8, radix_cpp::murmur3_hash, radix_cpp::huge_page_allocator<std::pair<std::string, int>>> M;
+  for (int i = 0; i < 100000; i++) M["key" + std::to_string(i)] = i;
+  REQUIRE(M["key99999"] == 99999);
+}
+
+#ifdef __linux__
+template <typename T>
+static void require_same(T & a, T & b) {
+  REQUIRE(a.size() == b.size());
+  REQUIRE(std::equal(a.begin(), a.end(), b.begin(), b.end()));
+}
+
+TEST_CASE( "saved tables can be mapped", "[persistent]") {
+  const std::string path = "radix_cpp_test.map";
+  radix_cpp::map<uint32_t, uint64_t> M;
+  for (uint32_t i = 0; i < 100000; i++) M[i * 2654435761u] = i;
+  for (uint32_t i = 0; i < 100000; i += 3) M.erase(i * 2654435761u);
+  M.save(path);
+
+  radix_cpp::map<uint32_t, uint64_t> L1, L2;
+  L1.load(path);
+  L2.load(path); // the base address is taken, so the second table is relocated
+  REQUIRE(L1.is_mapped());
+  REQUIRE(!M.is_mapped());
+  require_same(M, L1);
+  require_same(M, L2);
+  for (uint32_t i = 0; i < 100000; i++) {
+    auto it = L2.find(i * 2654435761u);
+    if (i % 3 == 0) {
+      REQUIRE(it == L2.end());
+    } else {
+      REQUIRE(it != L2.end());
+      REQUIRE(it->second == i);
+    }
+    auto ub = L1.upper_bound(i * 7919u), ub0 = M.upper_bound(i * 7919u);
+    REQUIRE((ub == L1.end()) == (ub0 == M.end()));
+    if (ub != L1.end()) REQUIRE(ub->first == ub0->first);
+  }
+  REQUIRE_THROWS_AS(L1.insert(std::make_pair(1u, 1ul)), std::logic_error);
+  REQUIRE_THROWS_AS(L1.erase(L1.begin()), std::logic_error);
+  REQUIRE(L1.erase(3u) == 0);
+  REQUIRE_THROWS_AS(L1[3u], std::logic_error);
+
+  // the values can be changed in place, which doesn't change the file
+  L1.at(2654435761u) = 5;
+  L1[2u * 2654435761u]++;
+  L1.begin()->second = 7;
+  REQUIRE(L1.at(2654435761u) == 5);
+  REQUIRE(L1.at(2u * 2654435761u) == 3);
+  REQUIRE(L1.begin()->second == 7);
+  require_same(M, L2);
+
+  // the mapping is released by clear, after which the table can be used normally
+  L1.clear();
+  REQUIRE(!L1.is_mapped());
+  L1[1] = 2;
+  REQUIRE(L1.size() == 1);
+  auto L3 = std::move(L2);
+  REQUIRE(L3.is_mapped());
+  require_same(M, L3);
+
+  radix_cpp::set<uint64_t> S;
+  for (uint64_t i = 0; i < 50000; i++) S.insert(i << (i % 40));
+  for (uint64_t i = 0; i < 50000; i += 5) S.erase(i << (i % 40));
+  S.save(path);
+  radix_cpp::set<uint64_t> S2;
+  S2.load(path);
+  require_same(S, S2);
+  REQUIRE(S2.count(uint64_t(1) << 1) == 1);
+
+  radix_cpp::set<uint64_t> E;
+  E.save(path);
+  S2.load(path);
+  REQUIRE(S2.empty());
+  REQUIRE(S2.begin() == S2.end());
+  REQUIRE_THROWS_AS(L1.load(path), std::runtime_error);
+  REQUIRE(L1.size() == 1);
+
+  // a tampered header is rejected: the sections must lie within the file, and the table size must be a power of two
+  S.save(path);
+  auto tamper = [&](size_t field, uint64_t value) {
+    std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+    uint64_t old_value;
+    file.seekg(static_cast<std::streamoff>(field * sizeof(uint64_t)));
+    file.read(reinterpret_cast<char *>(&old_value), sizeof(old_value));
+    file.seekp(static_cast<std::streamoff>(field * sizeof(uint64_t)));
+    file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    return old_value;
+  };
+  // the fields after the magic: version, digit_bits, node_size, level_size, value_size, flags, hash_check,
+  // base, table_size, num_entries, num_final_entries, num_tombstones, num_levels, num_payloads,
+  // nodes_offset, top_offset, levels_offset, payloads_offset and file_size
+  const size_t table_size = 9, num_levels = 13, num_payloads = 14, nodes_offset = 15, top_offset = 16, levels_offset = 17, payloads_offset = 18;
+  auto table_size0 = tamper(table_size, 0);
+  tamper(table_size, table_size0 - 1);
+  REQUIRE_THROWS_AS(S2.load(path), std::runtime_error);
+  tamper(table_size, table_size0 << 20);
+  REQUIRE_THROWS_AS(S2.load(path), std::runtime_error);
+  tamper(table_size, UINT64_C(1) << 63);
+  REQUIRE_THROWS_AS(S2.load(path), std::runtime_error);
+  tamper(table_size, table_size0);
+  for (auto field : { num_levels, num_payloads, nodes_offset, top_offset, levels_offset, payloads_offset }) {
+    auto value = tamper(field, UINT64_MAX / 2);
+    REQUIRE_THROWS_AS(S2.load(path), std::runtime_error);
+    tamper(field, value + 8);
+    if (field != num_levels && field != num_payloads) REQUIRE_THROWS_AS(S2.load(path), std::runtime_error);
+    tamper(field, value);
+  }
+  S2.load(path);
+  require_same(S, S2);
+
+  // a relocated table checks its pointers: with a wrong base, which can't be mapped, none of them points to
+  // a Node or a payload
+  M.save(path);
+  tamper(8, tamper(8, 0) + 8);
+  REQUIRE_THROWS_AS(L2.load(path), std::runtime_error);
+  REQUIRE(!L2.is_mapped());
+  REQUIRE(L2.empty());
+  std::remove(path.c_str());
+}
+#endif
+
+TEST_CASE( "order statistics", "[rank]") {
+  radix_cpp::set<uint32_t> S;
+  std::vector<uint32_t> keys;
+  for (uint32_t i = 0; i < 20000; i++) {
+    S.insert(i * 2654435761u);
+    keys.push_back(i * 2654435761u);
+  }
+  for (uint32_t i = 0; i < 20000; i += 4) {
+    S.erase(i * 2654435761u);
+    keys.erase(std::find(keys.begin(), keys.end(), i * 2654435761u));
+  }
+  std::sort(keys.begin(), keys.end());
+  for (size_t i = 0; i < keys.size(); i += 7) {
+    REQUIRE(S.rank(keys[i]) == i);
+    REQUIRE(S.rank(keys[i] + 1) == i + 1);
+    REQUIRE(*S.nth(i) == keys[i]);
+  }
+  REQUIRE(S.rank(0) == 0);
+  REQUIRE(S.rank(UINT32_MAX) == keys.size() - (keys.back() == UINT32_MAX ? 1 : 0));
+  REQUIRE(S.nth(keys.size()) == S.end());
+  REQUIRE(S.count_range(keys[10], keys[1000]) == 990);
+  REQUIRE(S.count_range(keys[1000], keys[10]) == 0);
+  REQUIRE(S.count_range(0, UINT32_MAX) == static_cast<size_t>(std::distance(S.begin(), S.upper_bound(UINT32_MAX - 1))));
+
+  radix_cpp::map<std::string, int> M;
+  for (auto s : { "", "a", "ab", "abc", "abd", "b", "ba", "bab", "c" }) M[s] = 1;
+  REQUIRE(M.rank("") == 0);
+  REQUIRE(M.rank("a") == 1);
+  REQUIRE(M.rank("aa") == 2);
+  REQUIRE(M.rank("abcd") == 4);
+  REQUIRE(M.rank(std::string_view("b")) == 5);
+  REQUIRE(M.rank("bb") == 8);
+  REQUIRE(M.rank("d") == 9);
+  REQUIRE(M.nth(0)->first == "");
+  REQUIRE(M.nth(4)->first == "abd");
+  REQUIRE(M.nth(7)->first == "bab");
+  REQUIRE(M.count_range("ab", "b") == 3);
+
+  // bit prefixes have variable length, so they are ranked through their digits
+  using route = radix_cpp::bit_prefix<uint32_t>;
+  radix_cpp::Table<route, int, 1> R;
+  std::vector<route> routes = { route(0, 0), route(0x0a000000, 8), route(0x0a010000, 16), route(0x0a010100, 24), route(0xc0a80000, 16), route(0xc0a80101, 32) };
+  for (auto & r : routes) R[r] = 1;
+  std::sort(routes.begin(), routes.end());
+  for (size_t i = 0; i < routes.size(); i++) {
+    REQUIRE(R.rank(routes[i]) == i);
+    REQUIRE(R.nth(i)->first == routes[i]);
+  }
+  REQUIRE(R.rank(route(0x0a010000, 12)) == 2);
+  REQUIRE(R.rank(route(0x0a010100, 32)) == 4);
+  REQUIRE(R.rank(route(0xffffffff, 32)) == routes.size());
+  REQUIRE(R.count_range(route(0x0a000000, 8), route(0xc0a80000, 16)) == 3);
+  REQUIRE(R.count_range(route(0x0a000000, 7), route(0x0b000000, 8)) == 3);
+
+  radix_cpp::set<uint32_t> E;
+  REQUIRE(E.rank(5) == 0);
+  REQUIRE(E.nth(0) == E.end());
+}
+
+#ifdef RADIX_CPP_PMR
+TEST_CASE( "string_view lookups don't allocate", "[allocations]" ) {
+  counting_resource r;
+  radix_cpp::pmr::set<std::string> S(&r);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; i++) keys.push_back("a prefix that is too long for SSO/" + std::to_string(i * 7));
+  keys.push_back("a single key with a compressed path");
+  keys.push_back("");
+  for (auto & key : keys) S.insert(key);
+
+  std::vector<std::string> probes = keys;
+  for (int i = 0; i < 1000; i++) probes.push_back("a prefix that is too long for SSO/" + std::to_string(i * 7 + 3));
+  for (auto s : { "a prefix that is too long", "a single key", "a single key with a compressed path and more", "zzzzzzzzzzzzzzzzzzzzzzzz" }) probes.push_back(s);
+
+  // the lookups may not allocate from the table, nor from the default resource
+  auto previous = std::pmr::set_default_resource(&r);
+  auto allocated0 = r.allocated;
+  size_t num_found = 0, num_nonempty = 0;
+  std::string_view last(keys[keys.size() / 2]);
+  for (auto & probe : probes) {
+    std::string_view key(probe);
+    num_found += S.count(key);
+    if (S.find(key) != S.end()) num_found++;
+    if (S.lower_bound(key) != S.upper_bound(key)) num_found++;
+    auto [ first, second ] = S.equal_range(key);
+    if (first != second) num_found++;
+    if (!S.range(key, last).empty()) num_nonempty++;
+    if (!S.prefix_range(key.substr(0, key.size() - key.size() / 4)).empty()) num_nonempty++;
+  }
+  auto allocated = r.allocated - allocated0;
+  std::pmr::set_default_resource(previous);
+  REQUIRE(allocated == 0);
+  REQUIRE(num_found == 4 * keys.size());
+  REQUIRE(num_nonempty > 0);
+}
+#endif
+
+TEST_CASE( "lower_bound, equal_range and range", "[range]" ) {
+  radix_cpp::set<uint32_t> S;
+  for (uint32_t i = 0; i < 1000; i++) S.insert(i * 100);
+  REQUIRE(S.lower_bound(0) == S.find(0));
+  REQUIRE(S.lower_bound(1) == S.find(100));
+  REQUIRE(S.lower_bound(500) == S.find(500));
+  REQUIRE(S.lower_bound(99901) == S.end());
+  auto [ first, last ] = S.equal_range(700);
+  REQUIRE(first == S.find(700));
+  REQUIRE(last == S.find(800));
+  auto [ first2, last2 ] = S.equal_range(701);
+  REQUIRE(first2 == S.find(800));
+  REQUIRE(last2 == S.find(800));
+
+  std::vector<uint32_t> keys;
+  for (auto key : S.range(250, 1000)) keys.push_back(key);
+  REQUIRE(keys == std::vector<uint32_t>{ 300, 400, 500, 600, 700, 800, 900 });
+  REQUIRE(std::distance(S.range(0, 65536).begin(), S.range(0, 65536).end()) == 656);
+  REQUIRE(S.range(99900, UINT32_MAX).begin() == S.find(99900));
+  REQUIRE(S.range(99900, UINT32_MAX).end() == S.end());
+  REQUIRE(S.range(500, 500).empty());
+  REQUIRE(S.range(600, 500).empty());
+
+  radix_cpp::set<std::string> T;
+  for (auto s : { "", "a", "ab", "abc", "abd", "b", "ba", "bab", "c" }) T.insert(s);
+  REQUIRE(T.lower_bound("") == T.find(""));
+  REQUIRE(T.lower_bound("aa") == T.find("ab"));
+  REQUIRE(T.lower_bound(std::string_view("abcd")) == T.find("abd"));
+  REQUIRE(T.lower_bound("bb") == T.find("c"));
+  REQUIRE(T.lower_bound("d") == T.end());
+  REQUIRE(T.equal_range("ba").second == T.find("bab"));
+  std::vector<std::string> strings;
+  for (auto & s : T.range("ab", "bab")) strings.push_back(s);
+  REQUIRE(strings == std::vector<std::string>{ "ab", "abc", "abd", "b", "ba" });
+
+  // string_view bounds on long keys, compressed paths and keys between the stored ones
+  radix_cpp::set<std::string> L;
+  std::vector<std::string> long_keys;
+  for (int i = 0; i < 1000; i++) long_keys.push_back("a prefix that is too long for SSO/" + std::to_string(i * 7));
+  long_keys.push_back("a single key with a compressed path");
+  long_keys.push_back("");
+  for (auto & key : long_keys) L.insert(key);
+  std::sort(long_keys.begin(), long_keys.end());
+  std::vector<std::string> probes = long_keys;
+  for (int i = 0; i < 1000; i++) probes.push_back("a prefix that is too long for SSO/" + std::to_string(i * 7 + 3));
+  for (auto s : { "a prefix that is too long", "a single key", "a single key with a compressed path and more", "zzzzzzzzzzzzzzzzzzzzzzzz" }) probes.push_back(s);
+  std::string_view middle(long_keys[long_keys.size() / 2]);
+  auto same = [&](radix_cpp::set<std::string>::iterator it, std::vector<std::string>::iterator expected) {
+    return expected == long_keys.end() ? it == L.end() : it != L.end() && *it == *expected;
+  };
+  size_t num_lower = 0, num_upper = 0, num_equal = 0, num_range = 0;
+  for (auto & probe : probes) {
+    std::string_view key(probe);
+    if (same(L.lower_bound(key), std::lower_bound(long_keys.begin(), long_keys.end(), probe))) num_lower++;
+    if (same(L.upper_bound(key), std::upper_bound(long_keys.begin(), long_keys.end(), probe))) num_upper++;
+    auto [ lo, hi ] = L.equal_range(key);
+    if (lo == L.lower_bound(key) && hi == L.upper_bound(key)) num_equal++;
+    auto r = L.range(key, middle);
+    if (r.begin() == L.lower_bound(key) && (r.empty() || r.end() == L.lower_bound(middle))) num_range++;
+  }
+  REQUIRE(num_lower == probes.size());
+  REQUIRE(num_upper == probes.size());
+  REQUIRE(num_equal == probes.size());
+  REQUIRE(num_range == probes.size());
+
+  // the const overloads return const iterators
+  const auto & CS = S;
+  radix_cpp::set<uint32_t>::const_iterator it = CS.lower_bound(1);
+  REQUIRE(it == CS.find(100));
+  REQUIRE(CS.upper_bound(100) == CS.find(200));
+  REQUIRE(CS.equal_range(700).first == CS.find(700));
+  REQUIRE(CS.equal_range(700).second == CS.find(800));
+  keys.clear();
+  for (auto key : CS.range(250, 1000)) keys.push_back(key);
+  REQUIRE(keys == std::vector<uint32_t>{ 300, 400, 500, 600, 700, 800, 900 });
+  const auto & CT = T;
+  REQUIRE(CT.lower_bound(std::string_view("abcd")) == CT.find("abd"));
+  REQUIRE(CT.upper_bound("ba") == CT.find("bab"));
+  REQUIRE(CT.equal_range(std::string_view("b")).second == CT.find("ba"));
+  strings.clear();
+  for (auto & s : CT.range(std::string_view("ab"), std::string_view("bab"))) strings.push_back(s);
+  REQUIRE(strings == std::vector<std::string>{ "ab", "abc", "abd", "b", "ba" });
+
+  radix_cpp::set<uint32_t> E;
+  REQUIRE(E.lower_bound(5) == E.end());
+  REQUIRE(E.range(0, 10).empty());
+  REQUIRE(static_cast<const radix_cpp::set<uint32_t> &>(E).range(0, 10).empty());
+}
+
+TEST_CASE( "prefix ranges of string keys", "[prefix_range]" ) {
+  radix_cpp::map<std::string, int> M;
+  std::vector<std::string> keys = { "", "foo", "foo/bar/", "foo/bar/a", "foo/bar/b", "foo/bar/b/c", "foo/bar0", "foo/baz/quux/long/path", "foo/bat", "g\xff\xff", "h" };
+  for (auto & key : keys) M[key] = 1;
+  auto collect = [&](std::string_view prefix) {
+    std::vector<std::string> r;
+    for (auto & [ key, value ] : M.prefix_range(prefix)) r.push_back(key);
+    return r;
+  };
+  for (auto prefix : { "", "f", "foo", "foo/", "foo/bar/", "foo/bar/b", "foo/bar", "foo/baz", "foo/baz/quux/l", "foo/baz/quux/long/path", "foo/baz/x", "foo/bat", "g", "g\xff", "h", "x" }) {
+    std::vector<std::string> expected;
+    for (auto & key : keys) {
+      if (std::string_view(key).substr(0, std::string_view(prefix).size()) == prefix) expected.push_back(key);
+    }
+    std::sort(expected.begin(), expected.end());
+    REQUIRE(collect(prefix) == expected);
+    REQUIRE(M.count_prefix(prefix) == expected.size());
+    const auto & C = M;
+    REQUIRE(size_t(std::distance(C.prefix_range(prefix).begin(), C.prefix_range(prefix).end())) == expected.size());
+  }
+
+  // prefixes of long keys, of a compressed path and of keys between the stored ones
+  radix_cpp::set<std::string> L;
+  std::vector<std::string> long_keys;
+  for (int i = 0; i < 1000; i++) long_keys.push_back("a prefix that is too long for SSO/" + std::to_string(i * 7));
+  long_keys.push_back("a single key with a compressed path");
+  long_keys.push_back("");
+  for (auto & key : long_keys) L.insert(key);
+  std::sort(long_keys.begin(), long_keys.end());
+  std::vector<std::string> probes = long_keys;
+  for (int i = 0; i < 1000; i++) probes.push_back("a prefix that is too long for SSO/" + std::to_string(i * 7 + 3));
+  for (auto s : { "a prefix that is too long", "a single key", "a single key with a compressed path and more", "zzzzzzzzzzzzzzzzzzzzzzzz" }) probes.push_back(s);
+  size_t num_prefix = 0;
+  for (auto & probe : probes) {
+    std::string_view prefix(probe);
+    prefix = prefix.substr(0, prefix.size() - prefix.size() / 4);
+    auto r = L.prefix_range(prefix);
+    auto it = std::lower_bound(long_keys.begin(), long_keys.end(), prefix);
+    auto it2 = std::find_if(it, long_keys.end(), [&](const std::string & key) { return key.compare(0, prefix.size(), prefix) != 0; });
+    if ((it == long_keys.end() ? r.begin() == L.end() : (r.begin() != L.end() && *r.begin() == *it)) &&
+	(it2 == long_keys.end() ? r.end() == L.end() : (r.end() != L.end() && *r.end() == *it2))) num_prefix++;
+  }
+  REQUIRE(num_prefix == probes.size());
+
+  radix_cpp::set<std::string> E;
+  REQUIRE(E.prefix_range("a").empty());
+  REQUIRE(static_cast<const radix_cpp::set<std::string> &>(E).prefix_range("").empty());
+  REQUIRE(E.count_prefix("a") == 0);
+}
+
+TEST_CASE( "longest prefix match", "[longest_prefix_match]" ) {
+  using route = radix_cpp::bit_prefix<uint32_t>;
+  radix_cpp::Table<route, int, 1> R;
+  std::vector<std::pair<route, int>> routes = {
+    { route(0, 0), 0 },
+    { route(0x0a000000, 8), 1 },
+    { route(0x0a010000, 16), 2 },
+    { route(0x0a010100, 24), 3 },
+    { route(0xc0a80000, 16), 4 },
+    { route(0xc0a80101, 32), 5 },
+    { route(0xac100000, 12), 6 },
+  };
+  for (auto & [ r, v ] : routes) R[r] = v;
+  REQUIRE(R.size() == routes.size());
+  REQUIRE(route(0x0a0101ff, 24) == route(0x0a010100, 24));
+  REQUIRE(R.find(route(0x0a0101ff, 24))->second == 3);
+
+  auto lookup = [&](uint32_t address) {
+    auto it = R.longest_prefix_match(route(address, 32));
+    return it == R.end() ? -1 : it->second;
+  };
+  REQUIRE(lookup(0x0a010105) == 3);
+  REQUIRE(lookup(0x0a010205) == 2);
+  REQUIRE(lookup(0x0a020205) == 1);
+  REQUIRE(lookup(0x0b000000) == 0);
+  REQUIRE(lookup(0xc0a80101) == 5);
+  REQUIRE(lookup(0xc0a80102) == 4);
+  REQUIRE(lookup(0xac1f0001) == 6);
+  REQUIRE(lookup(0xac200001) == 0);
+  REQUIRE(R.longest_prefix_match(route(0x0a010000, 12))->second == 1);
+
+  // iteration visits the prefixes in tree order
+  std::vector<route> sorted;
+  for (auto & [ r, v ] : routes) sorted.push_back(r);
+  std::sort(sorted.begin(), sorted.end());
+  std::vector<route> iterated;
+  for (auto & [ r, v ] : R) iterated.push_back(r);
+  REQUIRE(iterated == sorted);
+
+  R.erase(route(0, 0));
+  REQUIRE(lookup(0x0b000000) == -1);
+
+  // random prefixes are compared with a linear search, and looked up in batches
+  radix_cpp::Table<route, int, 1> R2;
+  std::vector<route> prefixes;
+  uint32_t x = 12345;
+  for (int i = 0; i < 2000; i++) {
+    x = x * 1664525u + 1013904223u;
+    route r(x, 8 + (x >> 7) % 25);
+    if (R2.find(r) == R2.end()) prefixes.push_back(r);
+    R2[r] = i;
+  }
+  std::vector<route> queries;
+  for (int i = 0; i < 1000; i++) {
+    x = x * 1664525u + 1013904223u;
+    queries.push_back(i % 2 ? route(x, 32) : route(prefixes[x % prefixes.size()].bits | (x & 0xff), 32));
+  }
+  std::vector<radix_cpp::Table<route, int, 1>::iterator> results;
+  R2.longest_prefix_match(queries.begin(), queries.end(), std::back_inserter(results));
+  REQUIRE(results.size() == queries.size());
+  for (size_t i = 0; i < queries.size(); i++) {
+    const route * best = nullptr;
+    for (auto & p : prefixes) {
+      if (radix_cpp::is_prefix(p, queries[i]) && (!best || p.length > best->length)) best = &p;
+    }
+    if (best) {
+      REQUIRE(results[i] != R2.end());
+      REQUIRE(results[i]->first == *best);
+    } else {
+      REQUIRE(results[i] == R2.end());
+    }
+  }
+
+  // with 8-bit digits, the lengths are whole bytes
+  radix_cpp::Table<route, int> R8;
+  R8[route(0x0a000000, 8)] = 1;
+  R8[route(0x0a010100, 24)] = 3;
+  REQUIRE(R8.longest_prefix_match(route(0x0a010101, 32))->second == 3);
+  REQUIRE(R8.longest_prefix_match(route(0x0a010201, 32))->second == 1);
+  REQUIRE(R8.longest_prefix_match(route(0x0b010201, 32)) == R8.end());
+  // lengths that don't split into whole digits are rejected
+  REQUIRE_THROWS_AS(R8[route(0x0a000000, 12)], std::invalid_argument);
+  REQUIRE_THROWS_AS(R8.insert_or_assign(route(0xac100000, 12), 6), std::invalid_argument);
+  REQUIRE_THROWS_AS(R8.longest_prefix_match(route(0x0a010101, 30)), std::invalid_argument);
+  REQUIRE(R8.find(route(0x0a000000, 12)) == R8.end());
+  REQUIRE(R8.size() == 2);
+  const auto & C8 = R8;
+  REQUIRE(C8.longest_prefix_match(route(0x0a010101, 32))->second == 3);
+  REQUIRE(C8.longest_prefix_match(route(0x0b010201, 32)) == C8.cend());
+  std::vector<route> queries8 = { route(0x0a010101, 32), route(0x0a020202, 32), route(0x0b000000, 32) };
+  std::vector<radix_cpp::Table<route, int>::const_iterator> results8;
+  C8.longest_prefix_match(queries8.begin(), queries8.end(), std::back_inserter(results8));
+  REQUIRE(results8.size() == 3);
+  REQUIRE(results8[0]->second == 3);
+  REQUIRE(results8[1]->second == 1);
+  REQUIRE(results8[2] == C8.cend());
+
+  radix_cpp::map<std::string, int> M;
+  for (auto s : { "/", "/usr/", "/usr/local/", "/usr/local/share/doc/radix/" }) M[s] = 1;
+  REQUIRE(M.longest_prefix_match("/usr/local/bin/")->first == "/usr/local/");
+  REQUIRE(M.longest_prefix_match(std::string_view("/usr/lib"))->first == "/usr/");
+  REQUIRE(M.longest_prefix_match("/usr/local/share/doc/radix/README")->first == "/usr/local/share/doc/radix/");
+  REQUIRE(M.longest_prefix_match("/usr/local/share/doc/")->first == "/usr/local/");
+  REQUIRE(M.longest_prefix_match("usr") == M.end());
+  std::vector<std::string> paths = { "/usr/bin", "/usr/local/lib", "/etc" };
+  std::vector<radix_cpp::map<std::string, int>::iterator> matches;
+  M.longest_prefix_match(paths.begin(), paths.end(), std::back_inserter(matches));
+  REQUIRE(matches.size() == 3);
+  REQUIRE(matches[0]->first == "/usr/");
+  REQUIRE(matches[1]->first == "/usr/local/");
+  REQUIRE(matches[2]->first == "/");
+  M[""] = 1;
+  REQUIRE(M.longest_prefix_match("usr")->first == "");
+  const auto & CM = M;
+  REQUIRE(CM.longest_prefix_match("/usr/lib")->first == "/usr/");
+  REQUIRE(CM.longest_prefix_match(std::string("/usr/local/bin"))->first == "/usr/local/");
+
+  radix_cpp::map<std::string, int> E;
+  REQUIRE(E.longest_prefix_match("a") == E.end());
+}
+
+template <typename T>
+static void check_reverse_iteration(T & S) {
+  std::vector<typename T::key_type> forward, backward;
+  for (auto & key : S) forward.push_back(key);
+  for (auto it = S.rbegin(); it != S.rend(); ++it) backward.push_back(*it);
+  std::reverse(backward.begin(), backward.end());
+  REQUIRE(forward == backward);
+  if (!S.empty()) REQUIRE(S.back() == forward.back());
+  size_t n = 0;
+  for (auto it = S.end(); it != S.begin(); n++) --it;
+  REQUIRE(n == S.size());
+}
+
+TEST_CASE( "reverse iteration", "[reverse]" ) {
+  radix_cpp::set<uint32_t> S;
+  REQUIRE(S.rbegin() == S.rend());
+  uint32_t x = 1;
+  for (int i = 0; i < 5000; i++) {
+    x = x * 1664525u + 1013904223u;
+    S.insert(x >> (x % 24));
+  }
+  check_reverse_iteration(S);
+  REQUIRE(*std::prev(S.lower_bound(1000000)) < 1000000);
+  REQUIRE(*std::prev(S.end()) == S.back());
+  REQUIRE(std::prev(S.begin()) == S.end());
+  const auto & C = S;
+  REQUIRE(*C.crbegin() == C.back());
+  REQUIRE(*std::next(C.crbegin()) == *std::prev(S.end(), 2));
+
+  radix_cpp::Table<uint16_t, void, 1> S1;
+  for (uint16_t i = 0; i < 1000; i += 7) S1.insert(static_cast<uint16_t>(i * 61));
+  check_reverse_iteration(S1);
+
+  radix_cpp::set<std::string> T;
+  for (auto s : { "", "a", "ab", "abc", "abcdefgh", "b", "bcdefgh", "c", "ca", "cab", "cabbage", "zzzzzz" }) T.insert(s);
+  check_reverse_iteration(T);
+  auto it = T.find("cabbage");
+  REQUIRE(*--it == "cab");
+  REQUIRE(*--it == "ca");
+  REQUIRE(*--it == "c");
+  REQUIRE(*--it == "bcdefgh");
+  REQUIRE(*--it == "b");
+  REQUIRE(*--it == "abcdefgh");
+  it = T.upper_bound("ba");
+  REQUIRE(*--it == "b");
+  T.erase("");
+  T.erase("zzzzzz");
+  check_reverse_iteration(T);
+  REQUIRE(T.back() == "cabbage");
+
+  radix_cpp::map<std::string, int> M;
+  for (int i = 0; i < 3000; i++) M[std::to_string(i * 7919 % 10007)] = i;
+  for (int i = 0; i < 3000; i += 3) M.erase(std::to_string(i * 7919 % 10007));
+  std::vector<std::string> forward, backward;
+  for (auto & [ key, value ] : M) forward.push_back(key);
+  for (auto r = M.rbegin(); r != M.rend(); r++) backward.push_back(r->first);
+  std::reverse(backward.begin(), backward.end());
+  REQUIRE(forward == backward);
+  M.back().second = -1;
+  REQUIRE(M[forward.back()] == -1);
+}
+
+TEST_CASE( "unordered iteration", "[unordered]" ) {
+  radix_cpp::set<uint32_t> S;
+  REQUIRE(S.unordered_begin() == S.unordered_end());
+  uint64_t sum = 0;
+  for (uint32_t i = 0; i < 10000; i++) {
+    S.insert(i * 2654435761u);
+    sum += i * 2654435761u;
+  }
+  uint64_t sum2 = 0;
+  size_t n = 0;
+  for (auto it = S.unordered_begin(); it != S.unordered_end(); ++it, n++) sum2 += *it;
+  REQUIRE(n == S.size());
+  REQUIRE(sum2 == sum);
+  sum2 = 0;
+  S.for_each_unordered([&](uint32_t key) { sum2 += key; });
+  REQUIRE(sum2 == sum);
+
+  radix_cpp::map<std::string, int> M;
+  for (int i = 0; i < 2000; i++) M["key" + std::to_string(i * 37)] = i;
+  M["k"] = -1;
+  M[""] = -2;
+  auto check = [&]() {
+    std::vector<std::string> ordered, unordered, each;
+    for (auto & [ key, value ] : M) ordered.push_back(key);
+    for (auto it = M.unordered_begin(); it != M.unordered_end(); it++) unordered.push_back(it->first);
+    const auto & C = M;
+    C.for_each_unordered([&](const std::pair<std::string, int> & kv) { each.push_back(kv.first); });
+    std::sort(unordered.begin(), unordered.end());
+    std::sort(each.begin(), each.end());
+    REQUIRE(unordered == ordered);
+    REQUIRE(each == ordered);
+  };
+  check();
+  M.for_each_unordered([](auto & kv) { kv.second++; });
+  REQUIRE(M["k"] == 0);
+  for (int i = 0; i < 2000; i += 3) M.erase("key" + std::to_string(i * 37));
+  check();
+
+  radix_cpp::map<uint64_t, int> I;
+  I.set_incremental_resize(true);
+  for (uint64_t i = 0; i < 100000; i++) {
+    I[i * 11400714819323198485ull] = 1;
+    if (i % 9999 == 0) {
+      size_t count = 0;
+      for (auto it = I.unordered_begin(); it != I.unordered_end(); ++it) count += static_cast<size_t>(it->second);
+      REQUIRE(count == I.size());
+    }
+  }
+}
+
+#ifdef RADIX_CPP_PMR
+TEST_CASE( "presizing accounts for compressed paths", "[reserve]") {
+  // long keys only need a head and a final Node below their shared prefix, so presizing for every digit
+  // would allocate far more than the inserts do
+  std::vector<std::string> keys;
+  for (int i = 0; i < 20000; i++) keys.push_back(std::string(100, 'x') + "/" + std::to_string(i * 7919) + "/suffix");
+  counting_resource r1, r2, r3;
+  radix_cpp::pmr::set<std::string> S1(&r1), S2(&r2), S3(&r3);
+  for (auto & key : keys) S1.insert(key);
+  S2.insert(keys.begin(), keys.end());
+  S3.reserve(keys.size());
+  for (auto & key : keys) S3.insert(key);
+  REQUIRE(S2.size() == keys.size());
+  REQUIRE(S3.size() == keys.size());
+  REQUIRE(r2.peak < 2 * r1.peak);
+  REQUIRE(r3.peak < 2 * r1.peak);
+}
+#endif